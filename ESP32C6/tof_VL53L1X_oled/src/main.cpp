@@ -13,6 +13,12 @@ The range readings are in units of mm. */
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <Preferences.h>
+#include <I2CBus.h>
+
+// The display runs at 400 kHz, the sensor at 1 MHz
+I2CBus i2c;
+const uint8_t DISPLAY_ADDRESS = 0x3C;
+const uint8_t TOF_ADDRESS = 0x29;
 
 Adafruit_SSD1306 display = Adafruit_SSD1306();
 bool displayAvailable = false;
@@ -63,7 +69,9 @@ void setup() {
   Serial.print(F("Wakeup cause: "));
   Serial.println(wakeup_cause);
 
-  Wire.begin();
+  i2c.add(DISPLAY_ADDRESS, I2CBus::FAST, "SSD1306");
+  i2c.add(TOF_ADDRESS, I2CBus::FAST_PLUS, "VL53L1X");
+  i2c.begin();
 
   if (reset_reason == ESP_RST_POWERON
       || (reset_reason == ESP_RST_DEEPSLEEP
@@ -81,7 +89,13 @@ void loop() {
   Serial.println(tries);
   if (tries > 0) {
     tries--;
-    lox.readSingle(true);
+    {
+      I2CBus::Lock lock(i2c, TOF_ADDRESS);
+      lox.readSingle(true);
+      if (lox.timeoutOccurred()) {
+        lock.fail();
+      }
+    }
     measure = lox.ranging_data;
     // check for phase failures and invalid values
     if (measure.range_status == VL53L1X::RangeStatus::RangeValid) {
@@ -115,7 +129,7 @@ void showAppInfo() {
     display.println(lastSharedRange);
     display.print("Boot count: ");
     display.println(bootCount);
-    display.display();
+    flushDisplay();
     delay(3000);
   }
 }
@@ -136,12 +150,12 @@ void showRange(uint16_t range) {
     if (range != 0xffff) {
       display.print(range);
       display.print("cm");
-      display.display();
+      flushDisplay();
       delay(3000);
     } else {
       display.print("no data #");
       display.print(measure.range_status);
-      display.display();
+      flushDisplay();
       delay(500);
     }
   }
@@ -184,7 +198,8 @@ void ledOff() {
 void initDisplay() {
   // Initialize SSD1306 OLED display
   Serial.println(F("Display setup..."));
-  if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) {
+  I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
+  if (!display.begin(SSD1306_SWITCHCAPVCC, DISPLAY_ADDRESS)) {
     Serial.println(F("SSD1306 allocation failed"));
     goToDeepSleep();
   }
@@ -200,9 +215,15 @@ void initDisplay() {
   displayAvailable = true;
 }
 
+void flushDisplay() {
+  I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
+  display.display();
+}
+
 void enableDisplay() {
   if (displayAvailable) {
     // Turn display on
+    I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
     display.ssd1306_command(SSD1306_DISPLAYON);
   }
 }
@@ -210,6 +231,7 @@ void enableDisplay() {
 void disableDisplay() {
   if (displayAvailable) {
     // Turn display off
+    I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
     display.ssd1306_command(SSD1306_DISPLAYOFF);
   }
 }
@@ -219,13 +241,15 @@ void initToFSensor() {
   Serial.println(F("Time-of-flight sensor setup..."));
   enableToFSensor();
   delay(50);
+  I2CBus::Lock lock(i2c, TOF_ADDRESS);
   if (!lox.init()) {
+    lock.fail();
     Serial.println(F("Failed to detect/init VL53L1X"));
     if (displayAvailable) {
       display.clearDisplay();
       display.setCursor(0,0);
       display.print("No Sensor!");
-      display.display();
+      flushDisplay();
     }
     goToDeepSleep();
   }
@@ -256,6 +280,7 @@ void goToDeepSleep() {
   esp_sleep_enable_ext1_wakeup(1ULL << DSLEEP_WAKEUP_PIN, ESP_EXT1_WAKEUP_ANY_HIGH);
   // Store non-volatile variables
   preferences.end();
+  i2c.printStats(Serial);
   // Close down Serial
   Serial.println(F("Sleeping..."));
   Serial.flush();
@@ -0,0 +1,168 @@
+
+#include "BatteryMonitor.h"
+
+#include <driver/adc.h>
+
+// Reading the calibration from eFuse only needs to happen once per power on
+RTC_DATA_ATTR static esp_adc_cal_characteristics_t calChars;
+RTC_DATA_ATTR static bool calCached = false;
+
+BatteryMonitor::BatteryMonitor(int pin, float dividerRatio, uint16_t samples)
+    : pin(pin), channel(-1), dividerRatio(dividerRatio), samples(samples), started(false),
+      meanMv(0), minMv(0), underLoadMv(0), loadRunning(false), loadWaiter(NULL) {
+}
+
+bool BatteryMonitor::begin() {
+    int ch = digitalPinToAnalogChannel(pin);
+    if (ch < 0 || ch >= SOC_ADC_CHANNEL_NUM(0)) {
+        // Only ADC1 is supported in continuous mode
+        return false;
+    }
+
+    if (!calCached) {
+        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 0, &calChars);
+        calCached = true;
+    }
+
+    adc_digi_init_config_t initConfig = {};
+    initConfig.max_store_buf_size = 1024;
+    initConfig.conv_num_each_intr = BLOCK_SIZE * SOC_ADC_DIGI_RESULT_BYTES;
+    initConfig.adc1_chan_mask = BIT(ch);
+    if (adc_digi_initialize(&initConfig) != ESP_OK) {
+        return false;
+    }
+
+    static adc_digi_pattern_config_t pattern;
+    pattern.atten = ADC_ATTEN_DB_11;
+    pattern.channel = ch;
+    pattern.unit = 0;
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_digi_configuration_t config = {};
+    config.pattern_num = 1;
+    config.adc_pattern = &pattern;
+    config.sample_freq_hz = SAMPLE_FREQ_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+    if (adc_digi_controller_configure(&config) != ESP_OK) {
+        adc_digi_deinitialize();
+        return false;
+    }
+    channel = ch;
+    return true;
+}
+
+void BatteryMonitor::end() {
+    if (channel < 0) {
+        return;
+    }
+    if (loadRunning) {
+        stopLoadMeasurement();
+    }
+    if (started) {
+        adc_digi_stop();
+        started = false;
+    }
+    adc_digi_deinitialize();
+    channel = -1;
+}
+
+bool BatteryMonitor::measure(uint32_t timeoutMs) {
+    if (channel < 0) {
+        return false;
+    }
+    Accumulator acc = {0, 0, 0, 0, 0xffff};
+    adc_digi_start();
+    started = true;
+    uint32_t start = millis();
+    while (acc.count < samples && millis() - start < timeoutMs) {
+        // Blocks until the DMA has a buffer ready, other tasks run meanwhile
+        collect(acc, timeoutMs);
+    }
+    adc_digi_stop();
+    started = false;
+    if (acc.count == 0) {
+        return false;
+    }
+    meanMv = toMilliVolts((acc.sum + acc.count / 2) / acc.count);
+    minMv = acc.blockMin != 0xffff ? toMilliVolts(acc.blockMin) : meanMv;
+    return acc.count >= samples;
+}
+
+void BatteryMonitor::startLoadMeasurement() {
+    if (channel < 0 || loadRunning) {
+        return;
+    }
+    loadAcc = {0, 0, 0, 0, 0xffff};
+    loadRunning = true;
+    adc_digi_start();
+    started = true;
+    xTaskCreate(loadTask, "battload", 3072, this, 3, NULL);
+}
+
+void BatteryMonitor::stopLoadMeasurement() {
+    if (!loadRunning) {
+        return;
+    }
+    loadWaiter = xTaskGetCurrentTaskHandle();
+    loadRunning = false;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    loadWaiter = NULL;
+    adc_digi_stop();
+    started = false;
+    underLoadMv = loadAcc.blockMin != 0xffff ? toMilliVolts(loadAcc.blockMin) : 0;
+}
+
+void BatteryMonitor::loadTask(void *param) {
+    BatteryMonitor *self = (BatteryMonitor *)param;
+    while (self->loadRunning) {
+        self->collect(self->loadAcc, 20);
+    }
+    if (self->loadWaiter) {
+        xTaskNotifyGive(self->loadWaiter);
+    }
+    vTaskDelete(NULL);
+}
+
+uint16_t BatteryMonitor::mean() const {
+    return meanMv;
+}
+
+uint16_t BatteryMonitor::min() const {
+    return minMv;
+}
+
+uint16_t BatteryMonitor::underLoad() const {
+    return underLoadMv;
+}
+
+bool BatteryMonitor::collect(Accumulator &acc, uint32_t timeoutMs) {
+    uint8_t buf[BLOCK_SIZE * SOC_ADC_DIGI_RESULT_BYTES];
+    uint32_t len = 0;
+    if (adc_digi_read_bytes(buf, sizeof(buf), &len, timeoutMs) != ESP_OK) {
+        return false;
+    }
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        adc_digi_output_data_t *out = (adc_digi_output_data_t *)&buf[i];
+        if (out->type2.unit != 0 || out->type2.channel != channel) {
+            continue;
+        }
+        acc.sum += out->type2.data;
+        acc.count++;
+        acc.blockSum += out->type2.data;
+        if (++acc.blockCount == BLOCK_SIZE) {
+            // Averaging blocks filters out the noise of single conversions
+            uint16_t blockMean = acc.blockSum / BLOCK_SIZE;
+            if (blockMean < acc.blockMin) {
+                acc.blockMin = blockMean;
+            }
+            acc.blockSum = 0;
+            acc.blockCount = 0;
+        }
+    }
+    return true;
+}
+
+uint16_t BatteryMonitor::toMilliVolts(uint32_t raw) const {
+    return esp_adc_cal_raw_to_voltage(raw, &calChars) * dividerRatio;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_adc_cal.h>
+
+// Battery voltage measurement using the ADC in continuous (DMA) mode.
+// The conversions run in the background, so the calling task just waits
+// for the samples and the CPU is free to do other work in the meantime.
+// The ADC calibration curve is read once and cached in RTC memory.
+class BatteryMonitor {
+   public:
+    // `dividerRatio` is the ratio of the voltage divider in front of the pin,
+    // `samples` the number of conversions that get averaged per measurement
+    BatteryMonitor(int pin, float dividerRatio, uint16_t samples);
+
+    bool begin();
+    void end();
+
+    // Takes a measurement, returns false if the ADC didn't deliver in time
+    bool measure(uint32_t timeoutMs);
+    // Keeps sampling in the background until stopLoadMeasurement(). Used to
+    // find the lowest voltage while the radio is transmitting.
+    void startLoadMeasurement();
+    void stopLoadMeasurement();
+
+    // All voltages are in mV at the battery, 0 if not measured
+    uint16_t mean() const;
+    // Lowest average of BLOCK_SIZE consecutive samples
+    uint16_t min() const;
+    // Lowest block average seen during the last load measurement
+    uint16_t underLoad() const;
+
+   private:
+    static const uint16_t BLOCK_SIZE = 16;
+    static const uint32_t SAMPLE_FREQ_HZ = 20000;
+
+    struct Accumulator {
+        uint32_t sum;
+        uint32_t count;
+        uint32_t blockSum;
+        uint16_t blockCount;
+        uint16_t blockMin;
+    };
+
+    bool collect(Accumulator &acc, uint32_t timeoutMs);
+    uint16_t toMilliVolts(uint32_t raw) const;
+    static void loadTask(void *param);
+
+    int pin;
+    int channel;
+    float dividerRatio;
+    uint16_t samples;
+    bool started;
+    uint16_t meanMv;
+    uint16_t minMv;
+    uint16_t underLoadMv;
+    Accumulator loadAcc;
+    volatile bool loadRunning;
+    TaskHandle_t loadWaiter;
+};
@@ -0,0 +1,129 @@
+#include "DeviceRegistry.h"
+
+DeviceRegistry::DeviceRegistry(I2CBus &bus, Cache &cache, const Sensor *sensors, uint8_t count, uint8_t displayAddress)
+    : bus(bus), cache(cache), sensors(sensors), count(count), displayAddress(displayAddress) {
+}
+
+bool DeviceRegistry::begin() {
+    if (cache.probed) {
+        return false;
+    }
+    cache.sensor = 0;
+    cache.configured = false;
+    for (uint8_t i = 0; i < count; i++) {
+        // A sensor that is switched off doesn't answer
+        sensors[i].sensor->enable();
+        sleepFor(BOOT_TIME_MS);
+        if (bus.probe(sensors[i].address)) {
+            cache.sensor = i + 1;
+            break;
+        }
+        sensors[i].sensor->disable();
+    }
+    cache.display = bus.probe(displayAddress);
+    cache.probed = true;
+    return true;
+}
+
+void DeviceRegistry::forget() {
+    cache.probed = false;
+    cache.sensor = 0;
+    cache.display = false;
+    cache.configured = false;
+}
+
+const char *DeviceRegistry::sensorName() const {
+    const Sensor *s = current();
+    return s ? s->name : "none";
+}
+
+bool DeviceRegistry::init() {
+    const Sensor *s = current();
+    if (!s) {
+        // The sensor may just have been slow to boot, probe again next wake
+        forget();
+        return false;
+    }
+    if (cache.configured && s->sensor->resume()) {
+        return true;
+    }
+    if (!s->sensor->init()) {
+        forget();
+        return false;
+    }
+    cache.configured = true;
+    return true;
+}
+
+bool DeviceRegistry::check() {
+    const Sensor *s = current();
+    if (!s) {
+        forget();
+        return false;
+    }
+    const I2CBus::Device *dev = bus.device(s->address);
+    if (dev && dev->errors > 0) {
+        forget();
+        return false;
+    }
+    return true;
+}
+
+uint16_t DeviceRegistry::read() {
+    const Sensor *s = current();
+    return s ? s->sensor->read() : INVALID_RANGE;
+}
+
+bool DeviceRegistry::startMeasurement() {
+    const Sensor *s = current();
+    return s ? s->sensor->startMeasurement() : false;
+}
+
+bool DeviceRegistry::isReady() {
+    const Sensor *s = current();
+    return s ? s->sensor->isReady() : true;
+}
+
+uint16_t DeviceRegistry::fetch() {
+    const Sensor *s = current();
+    return s ? s->sensor->fetch() : INVALID_RANGE;
+}
+
+void DeviceRegistry::enable() {
+    const Sensor *s = current();
+    if (s) {
+        s->sensor->enable();
+    }
+}
+
+void DeviceRegistry::disable() {
+    const Sensor *s = current();
+    if (s) {
+        s->sensor->disable();
+    }
+}
+
+void DeviceRegistry::suspend() {
+    const Sensor *s = current();
+    if (!s) {
+        return;
+    }
+    if (cache.configured) {
+        s->sensor->suspend();
+    } else {
+        s->sensor->disable();
+    }
+}
+
+bool DeviceRegistry::watch(uint16_t low, uint16_t high, uint32_t periodMs) {
+    // Only a configured sensor can be resumed on the wake it causes
+    const Sensor *s = current();
+    return s && cache.configured && s->sensor->watch(low, high, periodMs);
+}
+
+const DeviceRegistry::Sensor *DeviceRegistry::current() const {
+    if (!cache.probed || cache.sensor == 0 || cache.sensor > count) {
+        return NULL;
+    }
+    return &sensors[cache.sensor - 1];
+}
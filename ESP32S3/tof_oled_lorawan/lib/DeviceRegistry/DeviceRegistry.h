@@ -0,0 +1,76 @@
+#pragma once
+
+#include <DistanceSensor.h>
+#include <I2CBus.h>
+
+// Finds out which distance sensor and whether a display is fitted, so the
+// same firmware works with any of the supported sensors. The bus is only
+// probed when nothing is known yet or after the sensor failed; what was
+// found is kept in a Cache in RTC memory so other wakes go straight to
+// measuring.
+//
+// Works as the distance sensor itself, calls are passed on to the sensor
+// that was found.
+class DeviceRegistry : public IDistanceSensor {
+   public:
+    // Time a sensor gets to boot after enable() before it is probed
+    static const uint32_t BOOT_TIME_MS = 2;
+
+    struct Sensor {
+        uint8_t address;
+        IDistanceSensor *sensor;
+        const char *name;
+    };
+
+    // What was found. Has no constructor so it can be put in RTC memory,
+    // a zeroed instance means the bus has to be probed.
+    struct Cache {
+        bool probed;
+        uint8_t sensor;   // 1 + index in the sensor list, 0 if none was found
+        bool display;
+        bool configured;  // The sensor kept its configuration from init()
+    };
+
+    // The sensors are probed in the order given, the first one that
+    // answers is used
+    DeviceRegistry(I2CBus &bus, Cache &cache, const Sensor *sensors, uint8_t count, uint8_t displayAddress);
+
+    // Probes the bus unless the cache already knows what is fitted. The
+    // bus has to be started. Returns true if the bus was probed.
+    bool begin();
+    // Forgets what was found, the next begin() probes again
+    void forget();
+
+    bool hasDisplay() const { return cache.display; }
+    bool hasSensor() const { return current() != NULL; }
+    // Name of the sensor that was found, "none" if there is none
+    const char *sensorName() const;
+
+    // Sets the sensor up, or picks up the configuration it kept from an
+    // earlier wake. Forgets everything when that fails or no sensor was
+    // found.
+    bool init();
+    // Forgets everything when no sensor was found or it had bus errors
+    // during this wake, so the next wake probes and sets it up again.
+    // Returns false then.
+    bool check();
+
+    uint16_t read();
+    bool startMeasurement();
+    bool isReady();
+    uint16_t fetch();
+    void enable();
+    void disable();
+    // Keeps the configuration of the sensor for the next wake if it can
+    void suspend();
+    bool watch(uint16_t low, uint16_t high, uint32_t periodMs);
+
+   private:
+    const Sensor *current() const;
+
+    I2CBus &bus;
+    Cache &cache;
+    const Sensor *sensors;
+    uint8_t count;
+    uint8_t displayAddress;
+};
@@ -1,13 +1,50 @@
 #pragma once
 
 #include <Arduino.h>
+#include <PowerDelay.h>
 
 class IDistanceSensor {
    public:
     static const uint16_t INVALID_RANGE = 0xffff;
+    static const uint32_t MEASUREMENT_TIMEOUT_MS = 500;
+
+    // Starts a measurement without waiting for it
+    virtual bool startMeasurement() { return false; }
+    // Returns true once the measurement can be fetched
+    virtual bool isReady() { return true; }
+    // Returns the result of the measurement
+    virtual uint16_t fetch() { return INVALID_RANGE; }
+
+    // Takes a measurement and waits for the result. The wait yields, so
+    // other tasks can run in the meantime.
+    virtual uint16_t read() {
+        if (!startMeasurement()) {
+            return INVALID_RANGE;
+        }
+        unsigned long start = millis();
+        while (!isReady()) {
+            if (millis() - start > MEASUREMENT_TIMEOUT_MS) {
+                return INVALID_RANGE;
+            }
+            sleepFor(1);
+        }
+        return fetch();
+    }
 
-    virtual uint16_t read() { return INVALID_RANGE; }
     virtual bool init() { return true; }
     virtual void enable() {}
     virtual void disable() {}
+
+    // Picks up a sensor that init() set up on an earlier wake and that
+    // kept its configuration during deep sleep. Returns false if it has to
+    // be set up again.
+    virtual bool resume() { return init(); }
+    // Like disable(), but keeps the configuration for resume() if the
+    // sensor can
+    virtual void suspend() { disable(); }
+
+    // Keeps measuring every `periodMs` on its own, also during deep sleep,
+    // and signals on its interrupt pin once a range is outside [low, high].
+    // resume() stops it. Returns false if the sensor can't do this.
+    virtual bool watch(uint16_t low, uint16_t high, uint32_t periodMs) { return false; }
 };
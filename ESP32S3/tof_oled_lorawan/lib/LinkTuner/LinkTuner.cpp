@@ -0,0 +1,119 @@
+#include "LinkTuner.h"
+
+namespace {
+// Power steps of the LoRaWAN TXPower field
+const int8_t POWER_STEP = 2;
+
+// Spreading factor of a data rate
+uint8_t spreadingFactor(const LinkTuner::Config &config, uint8_t dr) {
+    return 12 - (dr - config.minDatarate);
+}
+
+// SNR (dB) the SX126x needs to demodulate a spreading factor
+float requiredSnr(uint8_t sf) {
+    return -7.5f - 2.5f * (sf - 7);
+}
+}  // namespace
+
+uint8_t LinkTuner::datarate(const Config &config) const {
+    return valid ? dr : config.initialDatarate;
+}
+
+int8_t LinkTuner::txPower(const Config &config) const {
+    return valid ? power : config.maxPower;
+}
+
+bool LinkTuner::wantLinkCheck(const Config &config) const {
+    return !valid || uplinksSinceCheck >= config.linkCheckInterval;
+}
+
+void LinkTuner::uplinkSent() {
+    if (uplinksSinceCheck < 0xff) {
+        uplinksSinceCheck++;
+    }
+}
+
+void LinkTuner::linkCheck(const Config &config, uint8_t margin) {
+    init(config);
+    uplinksSinceCheck = 0;
+    // Measured by the gateways on our uplink, so it scales with our TX power
+    update(config, margin + (config.maxPower - power), true, true);
+}
+
+void LinkTuner::downlink(const Config &config, float snr) {
+    init(config);
+    // Measured on the gateway's transmission, which doesn't depend on our
+    // TX power, so it is only used for the data rate. The gateway transmits
+    // with more power than we do, so it's only trusted to slow down.
+    update(config, snr - requiredSnr(spreadingFactor(config, dr)), false, false);
+}
+
+void LinkTuner::linkCheckMissed(const Config &config) {
+    init(config);
+    // Back to full power first, then slow down one step at a time
+    if (power < config.maxPower) {
+        power = config.maxPower;
+    } else if (dr > config.minDatarate) {
+        dr--;
+    }
+    // Check again on the next uplink
+    uplinksSinceCheck = config.linkCheckInterval;
+    dirty = true;
+}
+
+bool LinkTuner::changed() const {
+    return dirty;
+}
+
+void LinkTuner::clearChanged() {
+    dirty = false;
+}
+
+void LinkTuner::update(const Config &config, float margin, bool setPower, bool speedUp) {
+    float required = requiredSnr(spreadingFactor(config, dr));
+
+    uint8_t newDr = config.minDatarate;
+    for (uint8_t d = config.maxDatarate; d > config.minDatarate; d--) {
+        if (margin + required - requiredSnr(spreadingFactor(config, d)) >= config.targetMargin) {
+            newDr = d;
+            break;
+        }
+    }
+    // Speed up one step at a time, a single good measurement could be luck
+    if (newDr > dr + 1) {
+        newDr = dr + 1;
+    }
+    if (!speedUp && newDr > dr) {
+        newDr = dr;
+    }
+
+    int8_t newPower = power;
+    if (setPower) {
+        float newMargin = margin + required - requiredSnr(spreadingFactor(config, newDr));
+        newPower = config.maxPower;
+        while (newMargin - POWER_STEP >= config.targetMargin && newPower - POWER_STEP >= config.minPower) {
+            newPower -= POWER_STEP;
+            newMargin -= POWER_STEP;
+        }
+    }
+
+    if (newDr > dr || newPower < power) {
+        // A link check on the next uplink confirms the weaker link
+        uplinksSinceCheck = config.linkCheckInterval;
+    }
+    if (newDr != dr || newPower != power) {
+        dr = newDr;
+        power = newPower;
+        dirty = true;
+    }
+}
+
+void LinkTuner::init(const Config &config) {
+    if (!valid) {
+        valid = true;
+        dirty = true;
+        dr = config.initialDatarate;
+        power = config.maxPower;
+        uplinksSinceCheck = 0;
+    }
+}
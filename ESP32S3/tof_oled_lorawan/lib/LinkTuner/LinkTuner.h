@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+// Picks the uplink data rate and TX power from the measured link margin,
+// instead of waiting for the network's ADR, which takes a long time to
+// converge when we only send about once a day. It uses the highest data
+// rate (lowest spreading factor) that leaves at least `targetMargin` dB of
+// margin, and lowers the TX power when there's margin to spare.
+// Data rates are assumed to map to SF12..SF7 at 125 kHz like in EU868.
+// Has no constructor so an instance can be put in RTC memory, a zeroed
+// instance starts out at `initialDatarate` and full power.
+// Only depends on the C standard library so it can be built for the host.
+class LinkTuner {
+   public:
+    struct Config {
+        int8_t targetMargin;        // dB of margin to keep
+        uint8_t minDatarate;        // DR of SF12
+        uint8_t maxDatarate;        // DR of the lowest SF we want to use
+        uint8_t initialDatarate;    // Used until the first measurement
+        int8_t minPower;            // dBm
+        int8_t maxPower;            // dBm
+        uint8_t linkCheckInterval;  // Uplinks between link checks
+    };
+
+    uint8_t datarate(const Config &config) const;
+    int8_t txPower(const Config &config) const;
+    // Returns true if the next uplink should carry a LinkCheckReq
+    bool wantLinkCheck(const Config &config) const;
+
+    // Call for every uplink that was sent
+    void uplinkSent();
+    // Margin (dB above the demodulation floor) from a LinkCheckAns
+    void linkCheck(const Config &config, uint8_t margin);
+    // SNR of a downlink received in RX1, which uses the uplink data rate.
+    // Only lowers the data rate, the TX power and faster data rates are set
+    // by link checks.
+    void downlink(const Config &config, float snr);
+    // A link check got no answer, the link got worse than we thought
+    void linkCheckMissed(const Config &config);
+
+    // True when the settings changed since the last call to clearChanged()
+    bool changed() const;
+    void clearChanged();
+
+   private:
+    // `margin` is for the current data rate, at full power if `setPower`
+    // and at the current power otherwise, which is then left alone. The
+    // data rate only goes up if `speedUp`.
+    void update(const Config &config, float margin, bool setPower, bool speedUp);
+    void init(const Config &config);
+
+    bool valid;
+    bool dirty;
+    uint8_t dr;
+    int8_t power;
+    uint8_t uplinksSinceCheck;
+};
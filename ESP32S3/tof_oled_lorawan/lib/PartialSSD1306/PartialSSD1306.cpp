@@ -0,0 +1,86 @@
+#include "PartialSSD1306.h"
+
+namespace {
+const uint8_t CONTROL_DATA = 0x40;
+
+// Bytes per I2C transaction, same limit as Adafruit_SSD1306 uses
+#if defined(I2C_BUFFER_LENGTH)
+const size_t WIRE_MAX = I2C_BUFFER_LENGTH;
+#else
+const size_t WIRE_MAX = 32;
+#endif
+}  // namespace
+
+PartialSSD1306::PartialSSD1306(uint8_t w, uint8_t h, TwoWire *twi, uint32_t clkDuring, uint32_t clkAfter)
+    : Adafruit_SSD1306(w, h, twi, -1, clkDuring, clkAfter), shown(NULL) {
+}
+
+PartialSSD1306::~PartialSSD1306() {
+    free(shown);
+}
+
+bool PartialSSD1306::begin(uint8_t switchvcc, uint8_t i2caddr) {
+    if (!Adafruit_SSD1306::begin(switchvcc, i2caddr)) {
+        return false;
+    }
+    free(shown);
+    shown = (uint8_t *)malloc(WIDTH * ((HEIGHT + 7) / 8));
+    return true;
+}
+
+void PartialSSD1306::display() {
+    Adafruit_SSD1306::display();
+    if (shown) {
+        memcpy(shown, getBuffer(), WIDTH * ((HEIGHT + 7) / 8));
+    }
+}
+
+void PartialSSD1306::update() {
+    if (!shown) {
+        // Don't know what's on the screen
+        display();
+        return;
+    }
+    uint8_t *buf = getBuffer();
+    wire->setClock(wireClk);
+    for (uint8_t page = 0; page < (HEIGHT + 7) / 8; page++) {
+        uint8_t *row = buf + page * WIDTH;
+        uint8_t *shownRow = shown + page * WIDTH;
+        int16_t first = 0;
+        while (first < WIDTH && row[first] == shownRow[first]) {
+            first++;
+        }
+        if (first == WIDTH) {
+            continue;
+        }
+        int16_t last = WIDTH - 1;
+        while (row[last] == shownRow[last]) {
+            last--;
+        }
+        sendWindow(page, first, last);
+        memcpy(shownRow + first, row + first, last - first + 1);
+    }
+    wire->setClock(restoreClk);
+}
+
+void PartialSSD1306::sendWindow(uint8_t page, uint8_t first, uint8_t last) {
+    const uint8_t window[] = {SSD1306_PAGEADDR, page, page, SSD1306_COLUMNADDR, first, last};
+    ssd1306_commandList(window, sizeof(window));
+
+    const uint8_t *data = getBuffer() + page * WIDTH + first;
+    uint16_t count = last - first + 1;
+    wire->beginTransmission(i2caddr);
+    wire->write(CONTROL_DATA);
+    size_t bytesOut = 1;
+    while (count--) {
+        if (bytesOut >= WIRE_MAX) {
+            wire->endTransmission();
+            wire->beginTransmission(i2caddr);
+            wire->write(CONTROL_DATA);
+            bytesOut = 1;
+        }
+        wire->write(*data++);
+        bytesOut++;
+    }
+    wire->endTransmission();
+}
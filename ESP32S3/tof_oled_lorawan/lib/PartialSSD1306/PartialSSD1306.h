@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Adafruit_SSD1306.h>
+
+// SSD1306 display that only sends what changed. It keeps a copy of what
+// is on the screen and update() only sends the columns of each 8 pixel
+// page that differ from it, using the page and column address window of
+// the controller. Changing a single line of text this way sends a few
+// dozen bytes instead of the whole frame. The bus runs at `clkDuring`
+// while sending and goes back to `clkAfter` afterwards.
+class PartialSSD1306 : public Adafruit_SSD1306 {
+   public:
+    PartialSSD1306(uint8_t w, uint8_t h, TwoWire *twi = &Wire, uint32_t clkDuring = 400000UL, uint32_t clkAfter = 100000UL);
+    ~PartialSSD1306();
+
+    bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0);
+
+    // Sends the whole frame
+    void display();
+    // Sends only the parts of the frame that changed since the last
+    // display() or update()
+    void update();
+
+   private:
+    void sendWindow(uint8_t page, uint8_t first, uint8_t last);
+
+    uint8_t *shown;  // What is on the screen, NULL if unknown
+};
@@ -0,0 +1,102 @@
+#include "PowerDelay.h"
+
+#include <driver/gpio.h>
+#include <esp_sleep.h>
+
+namespace {
+bool enabled = false;
+// Number of holds, and whether a task is in light sleep right now
+int holds = 0;
+bool sleeping = false;
+portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Claims the right to light sleep, false if more than `ownHolds` hold the
+// chip awake or another task already sleeps
+bool claimSleep(int ownHolds) {
+    portENTER_CRITICAL(&lock);
+    bool claimed = enabled && holds <= ownHolds && !sleeping;
+    if (claimed) {
+        sleeping = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    return claimed;
+}
+
+// Light sleep once the claim is made
+void lightSleep(uint32_t ms) {
+    // Whatever is still in the UART FIFO would be cut off
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup(ms * 1000ULL);
+    esp_light_sleep_start();
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+    portENTER_CRITICAL(&lock);
+    sleeping = false;
+    portEXIT_CRITICAL(&lock);
+}
+}  // namespace
+
+bool PowerDelay::begin(const uint8_t *keepPins, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        // Keep the normal pin configuration during sleep
+        gpio_sleep_sel_dis((gpio_num_t)keepPins[i]);
+    }
+    enabled = true;
+    return true;
+}
+
+bool PowerDelay::lightSleepEnabled() {
+    return enabled;
+}
+
+void PowerDelay::hold() {
+    portENTER_CRITICAL(&lock);
+    holds++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void PowerDelay::release() {
+    portENTER_CRITICAL(&lock);
+    if (holds > 0) {
+        holds--;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void PowerDelay::sleepHeld(uint32_t ms) {
+    unsigned long start = millis();
+    while (enabled) {
+        uint32_t waited = millis() - start;
+        if (waited + LIGHT_SLEEP_MIN_MS > ms) {
+            break;
+        }
+        if (claimSleep(1)) {
+            lightSleep(ms - waited);
+            return;
+        }
+        vTaskDelay(1);
+    }
+    uint32_t waited = millis() - start;
+    if (waited < ms) {
+        vTaskDelay(pdMS_TO_TICKS(ms - waited));
+    }
+}
+
+void sleepFor(uint32_t ms) {
+    if (ms == 0) {
+        return;
+    }
+    if (ms >= PowerDelay::LIGHT_SLEEP_MIN_MS && claimSleep(0)) {
+        lightSleep(ms);
+        return;
+    }
+    // Blocking the task lets the others run and the idle task save power
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void sleepForUs(uint32_t us) {
+    if (us < PowerDelay::MIN_SLEEP_US) {
+        delayMicroseconds(us);
+    } else {
+        sleepFor((us + 999) / 1000);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Waits that let the chip save power. Once begin() has been called, waits
+// of at least LIGHT_SLEEP_MIN_MS put the chip into light sleep, unless a
+// task that must not be paused holds it awake, see hold(). Light sleep
+// stops both cores, so anything that talks to the radio, the I2C bus or
+// the ADC has to hold. Shorter waits block the task so others can run,
+// and sub-millisecond ones busy-wait.
+namespace PowerDelay {
+
+// Waits shorter than this are busy-waits
+const uint32_t MIN_SLEEP_US = 1000;
+// Waits at least this long are spent in light sleep when allowed, going
+// to sleep and back takes a few milliseconds
+const uint32_t LIGHT_SLEEP_MIN_MS = 20;
+
+// Enables light sleep for long waits. Pins in `keepPins` keep their output
+// level and pull-ups during light sleep, use this for LEDs, enable lines
+// and the I2C bus.
+bool begin(const uint8_t *keepPins, uint8_t count);
+// True once begin() has been called
+bool lightSleepEnabled();
+
+// Keeps the chip out of light sleep until the matching release(), for
+// work that other tasks' waits must not pause. Nests, and can be called
+// from any task.
+void hold();
+void release();
+
+// Light sleep for `ms` from a task that holds the chip awake itself, for
+// waits where its own work is paused anyway (a radio backoff). Waits until
+// its hold is the only one and no other task is in light sleep, and only
+// blocks the task if that doesn't happen in time.
+void sleepHeld(uint32_t ms);
+
+}  // namespace PowerDelay
+
+// Waits `ms` milliseconds, in light sleep when nothing holds the chip awake
+void sleepFor(uint32_t ms);
+// Waits `us` microseconds, busy-waits when that's less than MIN_SLEEP_US
+void sleepForUs(uint32_t us);
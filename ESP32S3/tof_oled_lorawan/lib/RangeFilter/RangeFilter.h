@@ -0,0 +1,104 @@
+#pragma once
+
+#include <DistanceSensor.h>
+
+// Wraps a distance sensor and takes a burst of N readings for every read().
+// Readings that are too far from the median (measured in median absolute
+// deviations) are dropped and the rest is averaged. If fewer than
+// `minInliers` readings survive the result is INVALID_RANGE.
+// A longer burst rejects more noise but keeps the sensor awake longer.
+// Only read() filters. A burst is several measurements, so the single
+// measurement calls (startMeasurement(), isReady(), fetch()) aren't
+// supported and keep the defaults of IDistanceSensor: startMeasurement()
+// returns false.
+template <uint8_t N>
+class RangeFilter : public IDistanceSensor {
+   public:
+    // Scale factor that turns the MAD into a standard deviation estimate
+    static constexpr float MAD_SCALE = 1.4826f;
+
+    RangeFilter(IDistanceSensor &sensor, uint8_t minInliers = N / 2 + 1, float madLimit = 3.0f, uint16_t minSpread = 5)
+        : sensor(sensor), minInliers(minInliers), madLimit(madLimit), minSpread(minSpread), lastConfidence(0) {}
+
+    uint16_t read() {
+        uint16_t samples[N];
+        uint8_t cnt = 0;
+        for (uint8_t i = 0; i < N; i++) {
+            uint16_t range = sensor.read();
+            if (range != INVALID_RANGE) {
+                samples[cnt++] = range;
+            }
+        }
+        uint8_t inliers;
+        uint16_t range = filter(samples, cnt, &inliers);
+        lastConfidence = inliers * 100 / N;
+        return inliers >= minInliers ? range : INVALID_RANGE;
+    }
+
+    bool init() { return sensor.init(); }
+    void enable() { sensor.enable(); }
+    void disable() { sensor.disable(); }
+    bool resume() { return sensor.resume(); }
+    void suspend() { sensor.suspend(); }
+    bool watch(uint16_t low, uint16_t high, uint32_t periodMs) { return sensor.watch(low, high, periodMs); }
+
+    // Percentage of the last burst that ended up in the result
+    uint8_t confidence() const { return lastConfidence; }
+
+    // Returns the mean of the samples that are within `madLimit` MADs of
+    // the median (but at least `minSpread`). Reorders `samples`.
+    uint16_t filter(uint16_t *samples, uint8_t cnt, uint8_t *inliers) const {
+        *inliers = 0;
+        if (cnt == 0) {
+            return INVALID_RANGE;
+        }
+        sort(samples, cnt);
+        uint16_t med = median(samples, cnt);
+
+        uint16_t deviations[N];
+        for (uint8_t i = 0; i < cnt; i++) {
+            deviations[i] = deviation(samples[i], med);
+        }
+        sort(deviations, cnt);
+        float limit = madLimit * MAD_SCALE * median(deviations, cnt);
+        if (limit < minSpread) {
+            limit = minSpread;
+        }
+
+        uint32_t sum = 0;
+        for (uint8_t i = 0; i < cnt; i++) {
+            if (deviation(samples[i], med) <= limit) {
+                sum += samples[i];
+                (*inliers)++;
+            }
+        }
+        return (sum + *inliers / 2) / *inliers;
+    }
+
+   private:
+    static uint16_t deviation(uint16_t a, uint16_t b) {
+        return a > b ? a - b : b - a;
+    }
+
+    static uint16_t median(const uint16_t *sorted, uint8_t cnt) {
+        return cnt % 2 ? sorted[cnt / 2] : (sorted[cnt / 2 - 1] + sorted[cnt / 2] + 1) / 2;
+    }
+
+    static void sort(uint16_t *values, uint8_t cnt) {
+        // Insertion sort, bursts are short
+        for (uint8_t i = 1; i < cnt; i++) {
+            uint16_t v = values[i];
+            uint8_t j = i;
+            for (; j > 0 && values[j - 1] > v; j--) {
+                values[j] = values[j - 1];
+            }
+            values[j] = v;
+        }
+    }
+
+    IDistanceSensor &sensor;
+    uint8_t minInliers;
+    float madLimit;
+    uint16_t minSpread;
+    uint8_t lastConfidence;
+};
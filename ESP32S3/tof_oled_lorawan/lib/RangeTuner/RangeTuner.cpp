@@ -0,0 +1,73 @@
+#include "RangeTuner.h"
+
+// Reach from the VL53L1X datasheet, 88% reflectance target. The shortest
+// budget is 20 ms in short mode and 33 ms in the other modes.
+const RangeTuner::Setting RangeTuner::SETTINGS[] = {
+    {SHORT, 20000, 1300, 1300, 0x07},
+    {SHORT, 33000, 1360, 1350, 0x07},
+    {MEDIUM, 33000, 2900, 760, 0x0B},
+    {LONG, 33000, 3600, 730, 0x0F},
+    {LONG, 50000, 3600, 730, 0x0F},
+    {LONG, 75000, 3600, 730, 0x0F},
+    {LONG, 140000, 4000, 730, 0x0F},
+};
+const uint8_t RangeTuner::LEVELS = sizeof(SETTINGS) / sizeof(SETTINGS[0]);
+const uint8_t RangeTuner::DEFAULT_LEVEL = 5;
+
+uint8_t RangeTuner::start(const Config &config) {
+    if (!known || current >= LEVELS) {
+        current = DEFAULT_LEVEL;
+        return current;
+    }
+    if (floorWakes > 0) {
+        floorWakes--;
+        // Another range is worth another try
+        uint16_t change = lastRange > floorRange ? lastRange - floorRange : floorRange - lastRange;
+        if (change > floorRange / 10) {
+            floorWakes = 0;
+        }
+    }
+    // The level may have moved out of reach of the current setting
+    while (current + 1 < LEVELS && !reaches(current, config)) {
+        current++;
+    }
+    if (current > 0 && !belowFloor(current - 1) && lastSignal >= config.minSignalMcps * config.headroom && reaches(current - 1, config)) {
+        current--;
+    }
+    return current;
+}
+
+bool RangeTuner::result(const Config &config, bool valid, uint16_t rangeMm, float signalMcps, float ambientMcps) {
+    if (!valid || signalMcps < config.minSignalMcps) {
+        return false;
+    }
+    known = true;
+    lastRange = rangeMm;
+    lastSignal = signalMcps;
+    lastAmbient = ambientMcps;
+    return true;
+}
+
+bool RangeTuner::escalate() {
+    if (current + 1 >= LEVELS) {
+        return false;
+    }
+    if (floorWakes == 0 || current > floorLevel) {
+        floorLevel = current;
+    }
+    floorRange = lastRange;
+    floorWakes = FLOOR_WAKES;
+    current++;
+    return true;
+}
+
+bool RangeTuner::reaches(uint8_t level, const Config &config) const {
+    const Setting &s = SETTINGS[level];
+    uint16_t reach = lastAmbient >= config.brightAmbientMcps ? s.brightReachMm : s.darkReachMm;
+    // Keep a 10% margin
+    return lastRange + lastRange / 10 <= reach;
+}
+
+bool RangeTuner::belowFloor(uint8_t level) const {
+    return floorWakes > 0 && level <= floorLevel;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+// Picks the VL53L1X distance mode and timing budget. The settings are
+// ordered from the shortest measurement to the longest; a wake starts at
+// the setting that worked last time, or one below it when the last
+// reading had signal to spare and the shorter setting still reaches that
+// far. It only moves up when a reading is invalid or its signal is too
+// weak. A setting that failed isn't tried again for FLOOR_WAKES wakes, or
+// until the range changes, so a marginal setting doesn't cost a failed
+// reading on every other wake.
+// Has no constructor so an instance can be put in RTC memory, a zeroed
+// instance knows nothing and starts at DEFAULT_LEVEL.
+// Only depends on the C standard library so it can be built for the host.
+class RangeTuner {
+   public:
+    // Same values as VL53L1X::DistanceMode
+    enum Mode : uint8_t { SHORT, MEDIUM, LONG };
+
+    struct Setting {
+        Mode mode;
+        uint32_t budgetUs;
+        uint16_t darkReachMm;    // Maximum range without ambient light
+        uint16_t brightReachMm;  // Maximum range in bright ambient light
+        uint8_t vcselPeriodA;    // What the mode writes to RANGE_CONFIG__VCSEL_PERIOD_A
+    };
+
+    struct Config {
+        float minSignalMcps;      // Weaker readings don't count
+        float headroom;           // Try a shorter setting when the signal was this many times minSignalMcps
+        float brightAmbientMcps;  // Ambient rate above which brightReachMm applies
+    };
+
+    static const Setting SETTINGS[];
+    static const uint8_t LEVELS;
+    // What was used before there was a tuner: long mode, 75 ms
+    static const uint8_t DEFAULT_LEVEL;
+    // Wakes a failed setting is left alone
+    static const uint8_t FLOOR_WAKES = 16;
+
+    // Picks the setting to start the wake with and returns its level
+    uint8_t start(const Config &config);
+    // Feeds a reading taken at the current level. Returns false when it
+    // isn't good enough, escalate() then moves to the next setting.
+    bool result(const Config &config, bool valid, uint16_t rangeMm, float signalMcps, float ambientMcps);
+    // Moves to the next longer setting, false if there is none
+    bool escalate();
+
+    uint8_t level() const { return current; }
+    const Setting &setting() const { return SETTINGS[current]; }
+
+    // Level the sensor was last configured with, kept here because the
+    // sensor keeps its configuration during deep sleep
+    uint8_t applied() const { return appliedLevel; }
+    void setApplied(uint8_t level) { appliedLevel = level; }
+
+   private:
+    bool reaches(uint8_t level, const Config &config) const;
+    // True while `level` failed recently
+    bool belowFloor(uint8_t level) const;
+
+    bool known;
+    uint8_t current;
+    uint8_t appliedLevel;
+    uint16_t lastRange;
+    float lastSignal;
+    float lastAmbient;
+    // Highest level that failed, its range and the wakes it still counts
+    uint8_t floorLevel;
+    uint16_t floorRange;
+    uint8_t floorWakes;
+};
@@ -0,0 +1,44 @@
+
+#include "ReadingBuffer.h"
+
+void ReadingBuffer::push(const DepthReading &reading) {
+    if (!isValid()) {
+        clear();
+    }
+    if (size == CAPACITY) {
+        drop(1);
+    }
+    items[(first + size) % CAPACITY] = reading;
+    size++;
+}
+
+void ReadingBuffer::drop(uint8_t cnt) {
+    if (cnt >= count()) {
+        clear();
+    } else {
+        first = (first + cnt) % CAPACITY;
+        size -= cnt;
+    }
+}
+
+void ReadingBuffer::clear() {
+    first = 0;
+    size = 0;
+}
+
+uint8_t ReadingBuffer::count() const {
+    return isValid() ? size : 0;
+}
+
+const DepthReading &ReadingBuffer::at(uint8_t index) const {
+    return items[(first + index) % CAPACITY];
+}
+
+const DepthReading &ReadingBuffer::newest() const {
+    return at(count() - 1);
+}
+
+bool ReadingBuffer::isValid() const {
+    // Guard against RTC memory that doesn't hold a valid buffer
+    return first < CAPACITY && size <= CAPACITY;
+}
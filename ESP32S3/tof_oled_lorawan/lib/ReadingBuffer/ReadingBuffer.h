@@ -0,0 +1,31 @@
+#pragma once
+
+#include <DepthPayload.h>
+#include <stdint.h>
+
+// Fixed size ring buffer of readings, oldest first. It has no constructor
+// so an instance can be put in RTC memory (RTC_DATA_ATTR) to keep its
+// contents across deep sleep. A zeroed instance is an empty buffer.
+// Only depends on the C standard library so it can be built for the host.
+class ReadingBuffer {
+   public:
+    static const uint8_t CAPACITY = 16;
+
+    // Adds a reading, overwriting the oldest one when the buffer is full
+    void push(const DepthReading &reading);
+    // Removes the `cnt` oldest readings
+    void drop(uint8_t cnt);
+    void clear();
+
+    uint8_t count() const;
+    // Returns the reading at `index`, where 0 is the oldest
+    const DepthReading &at(uint8_t index) const;
+    const DepthReading &newest() const;
+
+   private:
+    bool isValid() const;
+
+    uint8_t first;
+    uint8_t size;
+    DepthReading items[CAPACITY];
+};
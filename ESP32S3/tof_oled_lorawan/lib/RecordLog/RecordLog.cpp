@@ -0,0 +1,68 @@
+
+#include "RecordLog.h"
+
+RecordLog::RecordLog(Preferences &prefs, const char *prefix) : prefs(prefs), prefix(prefix), lastSeq(0), lastSlot(SLOTS - 1), scanned(false) {
+}
+
+bool RecordLog::load(void *record, size_t size) {
+    if (size > MAX_RECORD_SIZE) {
+        return false;
+    }
+    bool found = false;
+    for (uint8_t slot = 0; slot < SLOTS; slot++) {
+        char key[16];
+        slotKey(slot, key);
+        Entry entry;
+        size_t len = prefs.getBytes(key, &entry, sizeof(entry));
+        if (len != offsetof(Entry, data) + size || entry.crc != crc8(entry.data, size)) {
+            continue;
+        }
+        if (!found || (int32_t)(entry.seq - lastSeq) > 0) {
+            memcpy(record, entry.data, size);
+            lastSeq = entry.seq;
+            lastSlot = slot;
+            found = true;
+        }
+    }
+    scanned = true;
+    return found;
+}
+
+bool RecordLog::append(const void *record, size_t size) {
+    if (size > MAX_RECORD_SIZE) {
+        return false;
+    }
+    if (!scanned) {
+        // Find out where the log currently ends
+        Entry tmp;
+        load(tmp.data, size);
+    }
+    Entry entry;
+    entry.seq = lastSeq + 1;
+    memcpy(entry.data, record, size);
+    entry.crc = crc8(entry.data, size);
+    uint8_t slot = (lastSlot + 1) % SLOTS;
+    char key[16];
+    slotKey(slot, key);
+    if (prefs.putBytes(key, &entry, offsetof(Entry, data) + size) == 0) {
+        return false;
+    }
+    lastSeq = entry.seq;
+    lastSlot = slot;
+    return true;
+}
+
+void RecordLog::slotKey(uint8_t slot, char *key) {
+    snprintf(key, 16, "%s%u", prefix, slot);
+}
+
+uint8_t RecordLog::crc8(const uint8_t *data, size_t size) {
+    uint8_t crc = 0xff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Append-only log of small fixed size records in NVS. Every append writes
+// the next key in a ring of SLOTS keys, tagged with a sequence number, and
+// load() picks the newest valid one. No key gets rewritten on every flush
+// and an interrupted write leaves the previous record intact.
+class RecordLog {
+   public:
+    static const uint8_t SLOTS = 8;
+    static const size_t MAX_RECORD_SIZE = 32;
+
+    // `prefix` is used to build the key names and must be at most 12 characters
+    RecordLog(Preferences &prefs, const char *prefix);
+
+    // Loads the newest record, returns false if there is none
+    bool load(void *record, size_t size);
+    bool append(const void *record, size_t size);
+
+   private:
+    struct Entry {
+        uint32_t seq;
+        uint8_t crc;
+        uint8_t data[MAX_RECORD_SIZE];
+    };
+
+    void slotKey(uint8_t slot, char *key);
+    static uint8_t crc8(const uint8_t *data, size_t size);
+
+    Preferences &prefs;
+    const char *prefix;
+    uint32_t lastSeq;
+    uint8_t lastSlot;
+    bool scanned;
+};
@@ -0,0 +1,31 @@
+#include "RetryBackoff.h"
+
+uint32_t RetryBackoff::fail(const Config &config, uint32_t random) {
+    if (failureCount < 0xff) {
+        failureCount++;
+    }
+    if (failureCount >= config.maxAttempts) {
+        return 0;
+    }
+    uint32_t delay = config.baseDelay;
+    for (uint8_t i = 1; i < failureCount && delay < config.maxDelay; i++) {
+        delay *= 2;
+    }
+    if (delay > config.maxDelay) {
+        delay = config.maxDelay;
+    }
+    // Spread the retries of devices that failed at the same time
+    uint32_t jitter = (uint64_t)delay * config.jitterPercent / 100;
+    if (jitter > 0) {
+        delay = delay - jitter + random % (2 * jitter + 1);
+    }
+    return delay > 0 ? delay : 1;
+}
+
+void RetryBackoff::reset() {
+    failureCount = 0;
+}
+
+uint8_t RetryBackoff::failures() const {
+    return failureCount;
+}
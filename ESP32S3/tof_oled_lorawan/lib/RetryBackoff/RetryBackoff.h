@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+// Exponential backoff with jitter for retrying a failed operation. It has
+// no constructor so an instance can be put in RTC memory to keep counting
+// failures across deep sleep. A zeroed instance has no failures.
+// Only depends on the C standard library so it can be built for the host.
+class RetryBackoff {
+   public:
+    struct Config {
+        uint32_t baseDelay;     // Delay (ms) after the first failure
+        uint32_t maxDelay;      // Upper limit of the delay (ms)
+        uint8_t jitterPercent;  // Random part of the delay, +/- percentage
+        uint8_t maxAttempts;    // Give up after this many failures
+    };
+
+    // Records a failed attempt and returns the delay (ms) before the next
+    // one, or 0 when it's time to give up. `random` can be any random number.
+    uint32_t fail(const Config &config, uint32_t random);
+    // Call after a successful attempt, or to start over
+    void reset();
+    uint8_t failures() const;
+
+   private:
+    uint8_t failureCount;
+};
@@ -1,39 +1,93 @@
 
 #include "SEN0590.h"
-#include <Wire.h>
+#include <PowerDelay.h>
 
-SEN0590::SEN0590() {
-    Wire.begin();
+SEN0590::SEN0590(I2CBus &bus) : bus(bus), state(IDLE), stateStart(0) {
 }
 
 uint16_t SEN0590::readDistance() {
+    if (!startMeasurement()) {
+        // Same as reading all zeroes
+        return 10;
+    }
+    while (!isReady()) {
+        sleepFor(1);
+    }
+    return fetchDistance();
+}
+
+bool SEN0590::startMeasurement() {
     uint8_t dat = 0xB0;
-    uint8_t buf[2] = {0};
+    if (!writeReg(0x10, &dat, 1)) {
+        state = IDLE;
+        return false;
+    }
+    state = MEASURING;
+    stateStart = millis();
+    return true;
+}
+
+bool SEN0590::isReady() {
+    switch (state) {
+        case MEASURING:
+            if (millis() - stateStart < MEASURE_TIME_MS) {
+                return false;
+            }
+            // Select the result register, it can be read a little later
+            if (!selectReg(0x02)) {
+                state = IDLE;
+                return true;
+            }
+            state = SELECTING;
+            stateStart = millis();
+            return false;
+        case SELECTING:
+            if (millis() - stateStart < SELECT_TIME_MS) {
+                return false;
+            }
+            state = READY;
+            return true;
+        default:
+            // Ready, or failed in which case fetchDistance() reports the error
+            return true;
+    }
+}
 
-    writeReg(0x10, &dat, 1);
-    delay(50);
-    readReg(0x02, buf, 2);
+uint16_t SEN0590::fetchDistance() {
+    uint8_t buf[2] = {0};
+    if (state == READY && readBytes(buf, 2) != 2) {
+        // Same as reading all zeroes
+        buf[0] = buf[1] = 0;
+    }
+    state = IDLE;
     uint16_t distance = buf[0] * 0x100 + buf[1] + 10;
 
     return distance;
 }
 
 uint8_t SEN0590::readReg(uint8_t reg, const void *pBuf, size_t size) {
+    if (!selectReg(reg)) {
+        return 0;
+    }
+    sleepFor(SELECT_TIME_MS);
+    return readBytes(pBuf, size);
+}
+
+bool SEN0590::selectReg(uint8_t reg) {
+    if (bus.write(ADDRESS, &reg, 1) != I2CBus::OK) {
+        Serial.println("ERROR: Sensor read failed!");
+        return false;
+    }
+    return true;
+}
+
+uint8_t SEN0590::readBytes(const void *pBuf, size_t size) {
     if (pBuf == NULL) {
         Serial.println("pBuf ERROR!! : null pointer");
     }
-    uint8_t *_pBuf = (uint8_t *)pBuf;
-    Wire.beginTransmission(SEN0590_ADDRESS);
-    Wire.write(&reg, 1);
-    if (Wire.endTransmission() != 0) {
-        Serial.println("ERROR: Sensor read failed!");
+    if (bus.read(ADDRESS, (uint8_t *)pBuf, size) != I2CBus::OK) {
         return 0;
     }
-    delay(20);
-    Wire.requestFrom(SEN0590_ADDRESS, (uint8_t)size);
-    for (uint16_t i = 0; i < size; i++) {
-        _pBuf[i] = Wire.read();
-    }
     return size;
 }
 
@@ -41,14 +95,14 @@ bool SEN0590::writeReg(uint8_t reg, const void *pBuf, size_t size) {
     if (pBuf == NULL) {
         Serial.println("pBuf ERROR!! : null pointer");
     }
-    uint8_t *_pBuf = (uint8_t *)pBuf;
-    Wire.beginTransmission(SEN0590_ADDRESS);
-    Wire.write(&reg, 1);
-
-    for (uint16_t i = 0; i < size; i++) {
-        Wire.write(_pBuf[i]);
+    // Register and data go out in one transaction
+    uint8_t buf[1 + MAX_WRITE];
+    if (size > MAX_WRITE) {
+        return 0;
     }
-    if (Wire.endTransmission() != 0) {
+    buf[0] = reg;
+    memcpy(buf + 1, pBuf, size);
+    if (bus.write(ADDRESS, buf, 1 + size) != I2CBus::OK) {
         Serial.println("ERROR: Sensor write failed!");
         return 0;
     } else {
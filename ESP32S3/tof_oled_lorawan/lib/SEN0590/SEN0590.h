@@ -1,15 +1,36 @@
 #pragma once
 
 #include <Arduino.h>
+#include <I2CBus.h>
 
 class SEN0590 {
    public:
-    SEN0590();
+    static const uint8_t ADDRESS = 0x74;  // I2C address of the SEN0590 sensor
+    static const uint32_t MAX_CLOCK = I2CBus::STANDARD;
+
+    // The bus has to be started before the sensor is used
+    SEN0590(I2CBus &bus);
     uint16_t readDistance();
 
+    // Non-blocking version of readDistance(): start the measurement, keep
+    // calling isReady() until it returns true and then fetch the result
+    bool startMeasurement();
+    bool isReady();
+    uint16_t fetchDistance();
+
    private:
-    const uint8_t SEN0590_ADDRESS = 0x74;  // I2C address of the SEN0590 sensor
+    const unsigned long MEASURE_TIME_MS = 50;  // Time the sensor needs to measure
+    const unsigned long SELECT_TIME_MS = 20;  // Time between selecting a register and reading it
+    static const size_t MAX_WRITE = 8;  // Longest register write
+
+    enum State { IDLE, MEASURING, SELECTING, READY };
 
     uint8_t readReg(uint8_t reg, const void *pBuf, size_t size);
+    bool selectReg(uint8_t reg);
+    uint8_t readBytes(const void *pBuf, size_t size);
     bool writeReg(uint8_t reg, const void *pBuf, size_t size);
+
+    I2CBus &bus;
+    State state;
+    unsigned long stateStart;
 };
@@ -1,11 +1,19 @@
 
 #include "SEN0590_DSensor.h"
 
-SEN0590_DSensor::SEN0590_DSensor() {
+SEN0590_DSensor::SEN0590_DSensor(I2CBus &bus) : sen0590(bus) {
 }
 
-uint16_t SEN0590_DSensor::read() {
-    uint16_t distance = sen0590.readDistance();
+bool SEN0590_DSensor::startMeasurement() {
+    return sen0590.startMeasurement();
+}
+
+bool SEN0590_DSensor::isReady() {
+    return sen0590.isReady();
+}
+
+uint16_t SEN0590_DSensor::fetch() {
+    uint16_t distance = sen0590.fetchDistance();
     if (distance > 10) {
         return distance;
     } else {
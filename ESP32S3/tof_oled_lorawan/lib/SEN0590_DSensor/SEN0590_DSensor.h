@@ -5,8 +5,10 @@
 
 class SEN0590_DSensor : public IDistanceSensor {
    public:
-    SEN0590_DSensor();
-    uint16_t read();
+    SEN0590_DSensor(I2CBus &bus);
+    bool startMeasurement();
+    bool isReady();
+    uint16_t fetch();
     bool init();
     void enable();
     void disable();
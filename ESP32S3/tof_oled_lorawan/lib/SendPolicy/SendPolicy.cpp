@@ -0,0 +1,46 @@
+#include "SendPolicy.h"
+
+namespace {
+uint16_t difference(uint16_t a, uint16_t b) {
+    return a > b ? a - b : b - a;
+}
+}  // namespace
+
+namespace SendPolicy {
+
+Reason check(const Config &config, const Shared &shared, uint16_t range, uint16_t voltage, uint16_t bootCount, uint8_t buffered) {
+    // Check if the range value actually changed enough
+    if (shared.range == NO_RANGE || difference(shared.range, range) >= config.rangeDelta) {
+        return RANGE_CHANGED;
+    }
+    // Do the same for the voltage
+    if (shared.voltage == 0 || difference(shared.voltage, voltage) >= config.voltageDelta) {
+        return VOLTAGE_CHANGED;
+    }
+    // Don't let the reading buffer overflow
+    if (buffered >= config.flushCount) {
+        return BUFFER_FULL;
+    }
+    // If we have booted more than a certain amount of times since the last send, send anyway
+    if ((uint16_t)(bootCount - shared.bootCount) >= config.bootDelta) {
+        return HEARTBEAT;
+    }
+    return NO_CHANGE;
+}
+
+const char *describe(Reason reason) {
+    switch (reason) {
+        case RANGE_CHANGED:
+            return "Range changed significantly, sending";
+        case VOLTAGE_CHANGED:
+            return "Voltage changed significantly, sending";
+        case BUFFER_FULL:
+            return "Enough readings collected, sending";
+        case HEARTBEAT:
+            return "Much time has passed since last update, sending";
+        default:
+            return "No significant changes, not sending";
+    }
+}
+
+}  // namespace SendPolicy
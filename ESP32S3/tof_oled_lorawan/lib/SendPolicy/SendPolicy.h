@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+// Decides whether a wake should result in an uplink. Only depends on the
+// C standard library so it can be built for the host.
+namespace SendPolicy {
+
+// Range value that means nothing has been shared yet
+const uint16_t NO_RANGE = 0xffff;
+
+struct Config {
+    uint16_t rangeDelta;    // Range change (mm) worth sending
+    uint16_t voltageDelta;  // Voltage change (mV) worth sending
+    uint8_t flushCount;     // Number of buffered readings that forces a send
+    uint16_t bootDelta;     // Number of wakes after which we send anyway
+};
+
+// What was last sent to the network
+struct Shared {
+    uint16_t range;      // NO_RANGE if nothing was sent yet
+    uint16_t voltage;    // 0 if nothing was sent yet
+    uint16_t bootCount;
+};
+
+enum Reason : uint8_t {
+    NO_CHANGE,
+    RANGE_CHANGED,
+    VOLTAGE_CHANGED,
+    BUFFER_FULL,
+    HEARTBEAT
+};
+
+// Returns why the new reading should be sent, or NO_CHANGE if it shouldn't
+Reason check(const Config &config, const Shared &shared, uint16_t range, uint16_t voltage, uint16_t bootCount, uint8_t buffered);
+
+// Short log message for `reason`
+const char *describe(Reason reason);
+
+}  // namespace SendPolicy
@@ -1,33 +1,160 @@
 
 #include "VL53L1X_DSensor.h"
 
-VL53L1X_DSensor::VL53L1X_DSensor() {
+#if defined(ESP_PLATFORM)
+#include <driver/gpio.h>
+#endif
+
+namespace {
+// What VL53L1X::setDistanceMode() writes for each mode
+struct ModeRegisters {
+    uint8_t vcselPeriodA;
+    uint8_t vcselPeriodB;
+    uint8_t validPhaseHigh;
+    uint8_t initialPhase;
+};
+const ModeRegisters MODE_REGISTERS[] = {
+    {0x07, 0x05, 0x38, 6},   // Short
+    {0x0B, 0x09, 0x78, 10},  // Medium
+    {0x0F, 0x0D, 0xB8, 14},  // Long
+};
+
+// Timing budget arithmetic of the driver, which keeps it private
+const uint32_t TIMING_GUARD_US = 4528;
+
+uint32_t macroPeriodUs(uint16_t fastOscFrequency, uint8_t vcselPeriod) {
+    uint32_t pllPeriodUs = ((uint32_t)0x01 << 30) / fastOscFrequency;
+    uint8_t vcselPeriodPclks = (vcselPeriod + 1) << 1;
+    uint32_t macroPeriod = (uint32_t)2304 * pllPeriodUs;
+    macroPeriod >>= 6;
+    macroPeriod *= vcselPeriodPclks;
+    macroPeriod >>= 6;
+    return macroPeriod;
+}
+
+uint32_t timeoutMclks(uint32_t timeoutUs, uint32_t macroPeriod) {
+    return ((timeoutUs << 12) + (macroPeriod >> 1)) / macroPeriod;
+}
+
+uint16_t encodeTimeout(uint32_t mclks) {
+    if (mclks == 0) {
+        return 0;
+    }
+    uint32_t lsByte = mclks - 1;
+    uint16_t msByte = 0;
+    while ((lsByte & 0xFFFFFF00) > 0) {
+        lsByte >>= 1;
+        msByte++;
+    }
+    return (msByte << 8) | (lsByte & 0xFF);
+}
+}  // namespace
+
+VL53L1X_DSensor::VL53L1X_DSensor(I2CBus &bus) : bus(bus), tuner(NULL), tuning(NULL) {
     measure.range_status = VL53L1X::RangeStatus::None;  // Set to invalid value
 }
 
-uint16_t VL53L1X_DSensor::read() {
-    sensor.readSingle(true);
+void VL53L1X_DSensor::setTuner(RangeTuner &tuner, const RangeTuner::Config &config) {
+    this->tuner = &tuner;
+    tuning = &config;
+}
+
+bool VL53L1X_DSensor::startMeasurement() {
+    // Only starts the measurement when not blocking
+    I2CBus::Lock lock(bus, ADDRESS);
+    if (tuner && tuner->level() != tuner->applied() && !configure(tuner->level())) {
+        lock.fail();
+        return false;
+    }
+    sensor.readSingle(false);
+    if (sensor.last_status != 0) {
+        lock.fail();
+        return false;
+    }
+    return true;
+}
+
+bool VL53L1X_DSensor::isReady() {
+    I2CBus::Lock lock(bus, ADDRESS);
+    return sensor.dataReady();
+}
+
+uint16_t VL53L1X_DSensor::fetch() {
+    {
+        I2CBus::Lock lock(bus, ADDRESS);
+        sensor.read(false);
+        if (sensor.last_status != 0) {
+            lock.fail();
+        }
+    }
     measure = sensor.ranging_data;
     // check for phase failures and invalid values
-    if (measure.range_status == VL53L1X::RangeStatus::RangeValid) {
-        return measure.range_mm;
-    } else {
-        return INVALID_RANGE;
+    bool valid = measure.range_status == VL53L1X::RangeStatus::RangeValid;
+    if (tuner && !tuner->result(*tuning, valid, measure.range_mm, measure.peak_signal_count_rate_MCPS, measure.ambient_count_rate_MCPS)) {
+        // The next reading uses a longer setting. A weak but valid reading
+        // only counts when there is none.
+        if (tuner->escalate()) {
+            return INVALID_RANGE;
+        }
     }
+    return valid ? measure.range_mm : INVALID_RANGE;
 }
 
 bool VL53L1X_DSensor::init() {
     enable();
-    delay(50);
+    sleepFor(50);
+    I2CBus::Lock lock(bus, ADDRESS);
     if (!sensor.init()) {
+        lock.fail();
         return false;
     }
-    sensor.setDistanceMode(VL53L1X::Long);
-    sensor.setMeasurementTimingBudget(75000);
+    if (tuner) {
+        return configure(tuner->start(*tuning));
+    }
+    sensor.setDistanceMode(DISTANCE_MODE);
+    sensor.setMeasurementTimingBudget(TIMING_BUDGET_US);
+    return true;
+}
+
+bool VL53L1X_DSensor::configure(uint8_t level) {
+    const RangeTuner::Setting &setting = RangeTuner::SETTINGS[level];
+    const ModeRegisters &mode = MODE_REGISTERS[setting.mode];
+    // Same registers as setDistanceMode() and setMeasurementTimingBudget(),
+    // but init() may not have run on this wake, so the oscillator frequency
+    // comes from the sensor instead of the driver
+    uint16_t fastOscFrequency = sensor.readReg16Bit(VL53L1X::OSC_MEASURED__FAST_OSC__FREQUENCY);
+    if (sensor.last_status != 0 || fastOscFrequency == 0 || setting.budgetUs <= TIMING_GUARD_US) {
+        return false;
+    }
+    sensor.writeReg(VL53L1X::RANGE_CONFIG__VCSEL_PERIOD_A, mode.vcselPeriodA);
+    sensor.writeReg(VL53L1X::RANGE_CONFIG__VCSEL_PERIOD_B, mode.vcselPeriodB);
+    sensor.writeReg(VL53L1X::RANGE_CONFIG__VALID_PHASE_HIGH, mode.validPhaseHigh);
+    sensor.writeReg(VL53L1X::SD_CONFIG__WOI_SD0, mode.vcselPeriodA);
+    sensor.writeReg(VL53L1X::SD_CONFIG__WOI_SD1, mode.vcselPeriodB);
+    sensor.writeReg(VL53L1X::SD_CONFIG__INITIAL_PHASE_SD0, mode.initialPhase);
+    sensor.writeReg(VL53L1X::SD_CONFIG__INITIAL_PHASE_SD1, mode.initialPhase);
+
+    // Half of the budget for each of the two ranging phases
+    uint32_t rangeTimeoutUs = (setting.budgetUs - TIMING_GUARD_US) / 2;
+    uint32_t macroPeriod = macroPeriodUs(fastOscFrequency, mode.vcselPeriodA);
+    uint32_t phasecalTimeout = timeoutMclks(1000, macroPeriod);
+    sensor.writeReg(VL53L1X::PHASECAL_CONFIG__TIMEOUT_MACROP, phasecalTimeout > 0xFF ? 0xFF : phasecalTimeout);
+    sensor.writeReg16Bit(VL53L1X::MM_CONFIG__TIMEOUT_MACROP_A, encodeTimeout(timeoutMclks(1, macroPeriod)));
+    sensor.writeReg16Bit(VL53L1X::RANGE_CONFIG__TIMEOUT_MACROP_A, encodeTimeout(timeoutMclks(rangeTimeoutUs, macroPeriod)));
+    macroPeriod = macroPeriodUs(fastOscFrequency, mode.vcselPeriodB);
+    sensor.writeReg16Bit(VL53L1X::MM_CONFIG__TIMEOUT_MACROP_B, encodeTimeout(timeoutMclks(1, macroPeriod)));
+    sensor.writeReg16Bit(VL53L1X::RANGE_CONFIG__TIMEOUT_MACROP_B, encodeTimeout(timeoutMclks(rangeTimeoutUs, macroPeriod)));
+    if (sensor.last_status != 0) {
+        return false;
+    }
+    tuner->setApplied(level);
     return true;
 }
 
 void VL53L1X_DSensor::enable() {
+#if defined(ESP_PLATFORM)
+    gpio_hold_dis((gpio_num_t)D7);
+#endif
     // Pin D7 should be connected to the sensor's XSHUT pin
     pinMode(D7, OUTPUT);
     // Pulling the pin high will enable the sensor
@@ -35,8 +162,63 @@ void VL53L1X_DSensor::enable() {
 }
 
 void VL53L1X_DSensor::disable() {
+#if defined(ESP_PLATFORM)
+    gpio_hold_dis((gpio_num_t)D7);
+#endif
     // Pin D7 should be connected to the sensor's XSHUT pin
     pinMode(D7, OUTPUT);
     // Pulling the pin low will put the sensor in sleep mode
     digitalWrite(D7, LOW);
 }
+
+bool VL53L1X_DSensor::resume() {
+    enable();
+    I2CBus::Lock lock(bus, ADDRESS);
+    // A sensor that lost power answers too, but has its defaults back
+    uint8_t vcselPeriod = tuner ? RangeTuner::SETTINGS[tuner->applied()].vcselPeriodA : VCSEL_PERIOD_LONG;
+    if (sensor.readReg16Bit(VL53L1X::IDENTIFICATION__MODEL_ID) != MODEL_ID
+        || sensor.readReg(VL53L1X::RANGE_CONFIG__VCSEL_PERIOD_A) != vcselPeriod) {
+        return false;
+    }
+    // Stop the ranging watch() may have started, single measurements
+    // signal on GPIO1 again
+    sensor.writeReg(VL53L1X::SYSTEM__MODE_START, MODE_ABORT);
+    sensor.writeReg(VL53L1X::SYSTEM__INTERRUPT_CONFIG_GPIO, INTERRUPT_NEW_SAMPLE);
+    sensor.writeReg(VL53L1X::SYSTEM__INTERRUPT_CLEAR, 0x01);
+    if (sensor.last_status != 0) {
+        lock.fail();
+        return false;
+    }
+    if (tuner) {
+        // A different setting gets configured by the first measurement
+        tuner->start(*tuning);
+    }
+    return true;
+}
+
+bool VL53L1X_DSensor::watch(uint16_t low, uint16_t high, uint32_t periodMs) {
+    I2CBus::Lock lock(bus, ADDRESS);
+    sensor.writeReg(VL53L1X::SYSTEM__INTERRUPT_CONFIG_GPIO, INTERRUPT_OUT_OF_WINDOW);
+    sensor.writeReg16Bit(VL53L1X::SYSTEM__THRESH_HIGH, high);
+    sensor.writeReg16Bit(VL53L1X::SYSTEM__THRESH_LOW, low);
+    // init() may not have run on this wake, so get the oscillator
+    // calibration from the sensor instead of the driver
+    uint16_t oscCalibrate = sensor.readReg16Bit(VL53L1X::RESULT__OSC_CALIBRATE_VAL) & 0x3FF;
+    sensor.writeReg32Bit(VL53L1X::SYSTEM__INTERMEASUREMENT_PERIOD, periodMs * oscCalibrate);
+    sensor.writeReg(VL53L1X::SYSTEM__INTERRUPT_CLEAR, 0x01);
+    sensor.writeReg(VL53L1X::SYSTEM__MODE_START, MODE_TIMED);
+    if (sensor.last_status != 0) {
+        lock.fail();
+        return false;
+    }
+    return true;
+}
+
+void VL53L1X_DSensor::suspend() {
+    enable();
+#if defined(ESP_PLATFORM)
+    // Keep XSHUT high during deep sleep
+    gpio_hold_en((gpio_num_t)D7);
+    gpio_deep_sleep_hold_en();
+#endif
+}
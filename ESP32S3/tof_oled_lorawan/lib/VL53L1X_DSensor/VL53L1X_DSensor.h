@@ -1,17 +1,55 @@
 #pragma once
 
 #include <DistanceSensor.h>
+#include <I2CBus.h>
+#include <RangeTuner.h>
 #include <VL53L1X.h>
 
 class VL53L1X_DSensor : public IDistanceSensor {
    public:
-    VL53L1X_DSensor();
-    uint16_t read();
+    static const uint8_t ADDRESS = 0x29;  // Default I2C address of the VL53L1X
+    // What the sensor supports, I2CBus::add() caps it at what the
+    // controller runs
+    static const uint32_t MAX_CLOCK = I2CBus::FAST_PLUS;
+
+    VL53L1X_DSensor(I2CBus &bus);
+    // Lets `tuner` pick the distance mode and timing budget instead of
+    // always using long mode and 75 ms. The tuner should live in RTC memory.
+    void setTuner(RangeTuner &tuner, const RangeTuner::Config &config);
+    bool startMeasurement();
+    bool isReady();
+    uint16_t fetch();
     bool init();
     void enable();
     void disable();
+    // The sensor is kept powered during deep sleep, so it keeps the
+    // configuration from init()
+    bool resume();
+    void suspend();
+    // Ranges in timed mode and pulls GPIO1 low once a range is outside
+    // [low, high], uses the distance threshold interrupt of the sensor
+    bool watch(uint16_t low, uint16_t high, uint32_t periodMs);
 
    private:
+    static const uint16_t MODEL_ID = 0xEACC;
+    static const VL53L1X::DistanceMode DISTANCE_MODE = VL53L1X::Long;
+    static const uint32_t TIMING_BUDGET_US = 75000;
+    // What init() writes to RANGE_CONFIG__VCSEL_PERIOD_A in long mode
+    static const uint8_t VCSEL_PERIOD_LONG = 0x0F;
+    // SYSTEM__INTERRUPT_CONFIG_GPIO values
+    static const uint8_t INTERRUPT_OUT_OF_WINDOW = 0x02;
+    static const uint8_t INTERRUPT_NEW_SAMPLE = 0x20;
+    // SYSTEM__MODE_START values
+    static const uint8_t MODE_TIMED = 0x40;
+    static const uint8_t MODE_ABORT = 0x80;
+
+    // Writes the distance mode and timing budget of a tuner level, expects
+    // the bus to be locked
+    bool configure(uint8_t level);
+
+    I2CBus &bus;
+    RangeTuner *tuner;
+    const RangeTuner::Config *tuning;
     VL53L1X sensor;
     VL53L1X::RangingData measure;
 };
@@ -0,0 +1,196 @@
+#include "WakeCycle.h"
+
+#include <RemoteConfig.h>
+
+void WakeCycle::begin(bool timerWake) {
+    retrying = retryPending && timerWake && buffer.count() > 0;
+    retryPending = false;
+    heartbeat = rangeWatched && timerWake && !retrying;
+    rangeWatched = false;
+    retryDelayMs = 0;
+}
+
+bool WakeCycle::retryWake() const {
+    return retrying;
+}
+
+bool WakeCycle::heartbeatWake() const {
+    return heartbeat;
+}
+
+bool WakeCycle::addReading(const SendPolicy::Config &policy, const DepthReading &reading, SendPolicy::Reason *reason) {
+    buffer.push(reading);
+    if (heartbeat) {
+        *reason = SendPolicy::HEARTBEAT;
+    } else {
+        *reason = SendPolicy::check(policy, lastShared, reading.range, reading.voltage, reading.bootCount, buffer.count());
+    }
+    if (*reason == SendPolicy::NO_CHANGE && !ackWaiting) {
+        return false;
+    }
+    resetRetries();
+    return true;
+}
+
+WakeCycle::Result WakeCycle::send(const Config &config, Link &link) {
+    retryDelayMs = 0;
+    for (;;) {
+        if (link.aborted()) {
+            return ABORTED;
+        }
+        if (!link.join()) {
+            if (!retryAfter(config, link, joinFailures.fail(config.joinBackoff, link.random()))) {
+                return retryDelayMs > 0 ? RETRY_LATER : FAILED;
+            }
+            continue;
+        }
+        joinFailures.reset();
+
+        uint8_t payload[RemoteConfig::ACK_SIZE + DepthPayload::MAX_SIZE + 1];
+        size_t maxLen = link.maxPayloadLen();
+        uint8_t port;
+        uint8_t used;
+        size_t len = encode(config, link, maxLen < sizeof(payload) ? maxLen : sizeof(payload), payload, &port, &used);
+        if (len == 0) {
+            return FAILED;
+        }
+        // Cleared before the uplink goes out, a command in its downlink
+        // sets it again
+        bool withAck = port == RemoteConfig::PORT;
+        if (withAck) {
+            ackWaiting = false;
+        }
+        if (link.send(payload, len, port)) {
+            if (used > 0) {
+                // The oldest readings go first, the network now has up to
+                // this one. Readings that didn't fit are compared against
+                // it on the next wake.
+                const DepthReading &sent = buffer.at(used - 1);
+                lastShared = {sent.range, sent.voltage, sent.bootCount};
+            }
+            buffer.drop(used);
+            sendFailures.reset();
+            return SENT;
+        }
+        if (withAck) {
+            ackWaiting = true;
+        }
+        if (!retryAfter(config, link, sendFailures.fail(config.sendBackoff, link.random()))) {
+            return retryDelayMs > 0 ? RETRY_LATER : FAILED;
+        }
+    }
+}
+
+void WakeCycle::acknowledge(uint8_t seq, uint8_t status) {
+    ackSeq = seq;
+    ackStatus = status;
+    ackWaiting = true;
+}
+
+bool WakeCycle::ackPending() const {
+    return ackWaiting;
+}
+
+bool WakeCycle::watchBand(uint16_t delta, uint16_t measured, uint16_t *low, uint16_t *high) const {
+    if (lastShared.range == SendPolicy::NO_RANGE) {
+        return false;
+    }
+    uint16_t center = lastShared.range;
+    if (measured != SendPolicy::NO_RANGE && (measured > center ? measured - center : center - measured) >= delta) {
+        center = measured;
+    }
+    // The sensor wakes us once a range is outside [low, high], SendPolicy
+    // sends from `delta` on
+    uint16_t inside = delta > 0 ? delta - 1 : 0;
+    *low = center > inside ? center - inside : 0;
+    *high = center < 0xffff - inside ? center + inside : 0xfffe;
+    return true;
+}
+
+uint64_t WakeCycle::sleepTime(const Config &config, const WakeScheduler &scheduler, const WakeScheduler::Config &schedule, bool watching) {
+    rangeWatched = watching;
+    retryPending = retryDelayMs > 0;
+    if (retryPending) {
+        return retryDelayMs;
+    }
+    if (watching) {
+        return config.heartbeatInterval * 1000ULL;
+    }
+    return scheduler.interval(schedule) * 1000ULL;
+}
+
+uint32_t WakeCycle::retryDelay() const {
+    return retryDelayMs;
+}
+
+ReadingBuffer &WakeCycle::readings() {
+    return buffer;
+}
+
+const ReadingBuffer &WakeCycle::readings() const {
+    return buffer;
+}
+
+const SendPolicy::Shared &WakeCycle::shared() const {
+    return lastShared;
+}
+
+void WakeCycle::setShared(const SendPolicy::Shared &shared) {
+    lastShared = shared;
+}
+
+size_t WakeCycle::encode(const Config &config, Link &link, size_t maxLen, uint8_t *buf, uint8_t *port, uint8_t *used) {
+    size_t len = 0;
+    *port = config.port;
+    *used = 0;
+    if (ackWaiting) {
+        len = RemoteConfig::encodeAck(ackSeq, (RemoteConfig::Status)ackStatus, buf, maxLen);
+        *port = RemoteConfig::PORT;
+    }
+    // The acknowledgement port has no room for the profile byte
+    bool profile = config.profilePort != 0 && !ackWaiting;
+    size_t reserved = len + (profile ? 1 : 0);
+    size_t room = maxLen > reserved ? maxLen - reserved : 0;
+    if (room > DepthPayload::MAX_SIZE) {
+        room = DepthPayload::MAX_SIZE;
+    }
+    if (buffer.count() == 1) {
+        // A single reading is cheaper to send on its own
+        size_t n = DepthPayload::encode(config.payloadVersion, buffer.newest(), buf + len, room);
+        len += n;
+        *used = n > 0 ? 1 : 0;
+    } else if (buffer.count() > 1) {
+        DepthReading batch[ReadingBuffer::CAPACITY];
+        for (uint8_t i = 0; i < buffer.count(); i++) {
+            batch[i] = buffer.at(i);
+        }
+        len += DepthPayload::encodeBatch(batch, buffer.count(), buf + len, room, used);
+    }
+    if (*used == 0 && !ackWaiting) {
+        // Nothing that could be sent
+        return 0;
+    }
+    if (profile) {
+        buf[len++] = link.profileSummary();
+        *port = config.profilePort;
+    }
+    return len;
+}
+
+bool WakeCycle::retryAfter(const Config &config, Link &link, uint32_t ms) {
+    if (ms == 0) {
+        resetRetries();
+        return false;
+    }
+    if (ms > config.lightSleepMax) {
+        retryDelayMs = ms;
+        return false;
+    }
+    link.lightSleep(ms);
+    return true;
+}
+
+void WakeCycle::resetRetries() {
+    joinFailures.reset();
+    sendFailures.reset();
+}
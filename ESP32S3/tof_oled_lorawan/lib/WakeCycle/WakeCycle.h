@@ -0,0 +1,117 @@
+#pragma once
+
+#include <DepthPayload.h>
+#include <ReadingBuffer.h>
+#include <RetryBackoff.h>
+#include <SendPolicy.h>
+#include <WakeScheduler.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The decisions of a wake once the range and the battery voltage are
+// known: whether to send, what goes into the uplink, how a failed join or
+// uplink is retried and how long to sleep. The radio is behind Link, so
+// the firmware runs it on RadioLib and the simulator on a fake network.
+// Keeps the readings that weren't sent yet, what the network was last
+// sent and the retry state. Has no constructor so an instance can be put
+// in RTC memory, a zeroed instance has nothing buffered and nothing shared
+// yet (see setShared()).
+// Only depends on the C standard library so it can be built for the host.
+class WakeCycle {
+   public:
+    struct Config {
+        RetryBackoff::Config joinBackoff;
+        RetryBackoff::Config sendBackoff;
+        uint32_t lightSleepMax;      // Longer backoffs (ms) are waited out in deep sleep
+        uint8_t payloadVersion;      // Format of single readings, see DepthPayload
+        uint8_t port;                // Port of the readings
+        uint8_t profilePort;         // Port of readings with a profile byte, 0 for none
+        uint32_t heartbeatInterval;  // Sleep (s) while the sensor watches the level
+    };
+
+    enum Result : uint8_t {
+        SENT,
+        RETRY_LATER,  // Retried in a wake of its own, see retryDelay()
+        FAILED,       // Out of attempts
+        ABORTED
+    };
+
+    // The radio side of an uplink
+    class Link {
+       public:
+        virtual ~Link() {}
+        // Joins unless there is a session already
+        virtual bool join() = 0;
+        // Largest payload the current data rate allows
+        virtual size_t maxPayloadLen() = 0;
+        // Sends an uplink and handles its downlink, a command in it goes
+        // to acknowledge(). False if the uplink wasn't sent.
+        virtual bool send(const uint8_t *payload, size_t len, uint8_t port) = 0;
+        // Waits out a short backoff
+        virtual void lightSleep(uint32_t ms) = 0;
+        virtual uint32_t random() = 0;
+        // Profile summary byte appended when Config::profilePort is set
+        virtual uint8_t profileSummary() { return 0; }
+        // True once the wake should stop trying
+        virtual bool aborted() { return false; }
+    };
+
+    // Call at the start of every wake, `timerWake` when the wake-up timer
+    // ended the sleep
+    void begin(bool timerWake);
+    // Woken only to retry the uplink, there is no new reading
+    bool retryWake() const;
+    // Timer wake while the sensor watched the level, always sends
+    bool heartbeatWake() const;
+
+    // Buffers the reading of this wake and returns true if it should be
+    // sent. `reason` is set to why, or NO_CHANGE when only a pending
+    // acknowledgement makes it go out. A new uplink gets a fresh set of
+    // retries.
+    bool addReading(const SendPolicy::Config &policy, const DepthReading &reading, SendPolicy::Reason *reason);
+    // Joins when needed and sends the buffered readings, oldest first, with
+    // a pending acknowledgement in front. Short backoffs are waited out in
+    // light sleep, longer ones end the wake.
+    Result send(const Config &config, Link &link);
+    // Result of a command from a downlink, goes out with the next uplink
+    void acknowledge(uint8_t seq, uint8_t status);
+    bool ackPending() const;
+
+    // Band (mm) for the sensor to watch during deep sleep, around the last
+    // shared range or around `measured` once that is outside already.
+    // Returns false if nothing was shared yet.
+    bool watchBand(uint16_t delta, uint16_t measured, uint16_t *low, uint16_t *high) const;
+    // Time (ms) to sleep until the next wake. `watching` is true when the
+    // sensor watches the level and wakes us, the timer is then only for the
+    // heartbeat. A pending retry comes first.
+    uint64_t sleepTime(const Config &config, const WakeScheduler &scheduler, const WakeScheduler::Config &schedule, bool watching);
+    // Backoff (ms) before the retry wake, 0 if none
+    uint32_t retryDelay() const;
+
+    ReadingBuffer &readings();
+    const ReadingBuffer &readings() const;
+    // What the network was last sent
+    const SendPolicy::Shared &shared() const;
+    // Restores what was shared, after RTC memory was lost
+    void setShared(const SendPolicy::Shared &shared);
+
+   private:
+    size_t encode(const Config &config, Link &link, size_t maxLen, uint8_t *buf, uint8_t *port, uint8_t *used);
+    // Waits `ms` before the next attempt and returns true, or returns false
+    // if it is given up on or done in a later wake
+    bool retryAfter(const Config &config, Link &link, uint32_t ms);
+    void resetRetries();
+
+    ReadingBuffer buffer;
+    SendPolicy::Shared lastShared;
+    RetryBackoff joinFailures;
+    RetryBackoff sendFailures;
+    uint32_t retryDelayMs;
+    bool retryPending;
+    bool rangeWatched;
+    bool retrying;
+    bool heartbeat;
+    bool ackWaiting;
+    uint8_t ackSeq;
+    uint8_t ackStatus;
+};
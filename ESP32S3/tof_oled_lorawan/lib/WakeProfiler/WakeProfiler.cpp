@@ -0,0 +1,102 @@
+#include "WakeProfiler.h"
+
+#include <esp_timer.h>
+
+void WakeProfiler::begin(uint16_t bootCount) {
+    if (!isValid()) {
+        first = 0;
+        size = 0;
+    }
+    Wake &wake = items[(first + size) % (HISTORY + 1)];
+    memset(&wake, 0, sizeof(wake));
+    wake.bootCount = bootCount;
+}
+
+void WakeProfiler::end() {
+    Wake &wake = items[(first + size) % (HISTORY + 1)];
+    wake.awakeUs = esp_timer_get_time();
+    if (size == HISTORY) {
+        first = (first + 1) % (HISTORY + 1);
+    } else {
+        size++;
+    }
+}
+
+void WakeProfiler::start(Phase phase) {
+    phaseStart[phase] = esp_timer_get_time();
+}
+
+void WakeProfiler::stop(Phase phase) {
+    Wake &wake = items[(first + size) % (HISTORY + 1)];
+    wake.phaseUs[phase] += (uint32_t)esp_timer_get_time() - phaseStart[phase];
+}
+
+void WakeProfiler::retry(Phase phase) {
+    Wake &wake = items[(first + size) % (HISTORY + 1)];
+    if (wake.retries[phase] < 0xff) {
+        wake.retries[phase]++;
+    }
+}
+
+uint8_t WakeProfiler::count() const {
+    return isValid() ? size : 0;
+}
+
+const WakeProfiler::Wake &WakeProfiler::at(uint8_t index) const {
+    return items[(first + index) % (HISTORY + 1)];
+}
+
+uint8_t WakeProfiler::summary() const {
+    if (count() == 0) {
+        return 0;
+    }
+    const Wake &wake = at(count() - 1);
+    uint32_t secs = (wake.awakeUs + 999999) / 1000000;
+    uint16_t retries = 0;
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+        retries += wake.retries[i];
+    }
+    return (min(secs, (uint32_t)15) << 4) | min(retries, (uint16_t)15);
+}
+
+void WakeProfiler::dump(Print &out) const {
+    out.print(F("Boot   Awake"));
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+        out.printf(" %9s", phaseName((Phase)i));
+    }
+    out.println(F("  (ms/retries)"));
+    for (uint8_t i = 0; i < count(); i++) {
+        const Wake &wake = at(i);
+        out.printf("%5u %6lu", wake.bootCount, (unsigned long)(wake.awakeUs / 1000));
+        for (uint8_t j = 0; j < PHASE_COUNT; j++) {
+            out.printf(" %6lu/%-2u", (unsigned long)(wake.phaseUs[j] / 1000), wake.retries[j]);
+        }
+        out.println();
+    }
+}
+
+const char *WakeProfiler::phaseName(Phase phase) {
+    switch (phase) {
+        case PHASE_NVS:
+            return "nvs";
+        case PHASE_RADIO:
+            return "radio";
+        case PHASE_DISPLAY:
+            return "display";
+        case PHASE_SENSOR:
+            return "sensor";
+        case PHASE_RANGE:
+            return "range";
+        case PHASE_JOIN:
+            return "join";
+        case PHASE_SEND:
+            return "send";
+        default:
+            return "?";
+    }
+}
+
+bool WakeProfiler::isValid() const {
+    // Guard against RTC memory that doesn't hold a valid history
+    return first <= HISTORY && size <= HISTORY;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Records how long each phase of a wake takes and how many retries it
+// needed, for the last HISTORY wakes. It has no constructor so an instance
+// can be put in RTC memory (RTC_DATA_ATTR) to keep its history across deep
+// sleep. A zeroed instance has no history.
+// Phases can run concurrently in different tasks, but each phase must be
+// started and stopped from the same task.
+class WakeProfiler {
+   public:
+    enum Phase : uint8_t {
+        PHASE_NVS,
+        PHASE_RADIO,
+        PHASE_DISPLAY,
+        PHASE_SENSOR,
+        PHASE_RANGE,
+        PHASE_JOIN,
+        PHASE_SEND,
+        PHASE_COUNT
+    };
+
+    static const uint8_t HISTORY = 8;
+
+    struct Wake {
+        uint16_t bootCount;
+        uint32_t awakeUs;  // From boot until end() was called
+        uint32_t phaseUs[PHASE_COUNT];
+        uint8_t retries[PHASE_COUNT];
+    };
+
+    // Starts a new record for the current wake
+    void begin(uint16_t bootCount);
+    // Closes the record of the current wake and adds it to the history
+    void end();
+
+    // Time between start() and stop() is added to the phase, so a phase
+    // can be measured in several parts
+    void start(Phase phase);
+    void stop(Phase phase);
+    void retry(Phase phase);
+
+    // Number of completed wakes in the history
+    uint8_t count() const;
+    // Returns the completed wake at `index`, where 0 is the oldest
+    const Wake &at(uint8_t index) const;
+
+    // Single byte summary of the last completed wake: the awake time in
+    // seconds (rounded up, max 15) in the high nibble and the total number
+    // of retries (max 15) in the low nibble
+    uint8_t summary() const;
+
+    // Writes the history as a table, oldest first
+    void dump(Print &out) const;
+
+    static const char *phaseName(Phase phase);
+
+   private:
+    bool isValid() const;
+
+    uint8_t first;
+    uint8_t size;
+    Wake items[HISTORY + 1];  // The extra slot holds the current wake
+    uint32_t phaseStart[PHASE_COUNT];
+};
@@ -0,0 +1,56 @@
+
+#include "WakeScheduler.h"
+
+namespace {
+// Weight of the newest measurement in the slope average
+const float SLOPE_WEIGHT = 0.5f;
+
+uint32_t clampInterval(const WakeScheduler::Config &config, float interval) {
+    if (interval < config.minInterval) {
+        return config.minInterval;
+    }
+    if (interval > config.maxInterval) {
+        return config.maxInterval;
+    }
+    return (uint32_t)interval;
+}
+}  // namespace
+
+uint32_t WakeScheduler::update(const Config &config, uint32_t now, uint16_t range) {
+    uint32_t elapsed = now - lastTime;
+    if (!hasHistory || elapsed == 0) {
+        lastTime = now;
+        lastRange = range;
+        hasHistory = true;
+        slopePerHour = 0;
+        nextInterval = config.maxInterval;
+        return nextInterval;
+    }
+
+    uint16_t change = range > lastRange ? range - lastRange : lastRange - range;
+    float measured = change * 3600.0f / elapsed;
+    slopePerHour = SLOPE_WEIGHT * measured + (1 - SLOPE_WEIGHT) * slopePerHour;
+
+    if (change * 2 >= config.significantDelta && slopePerHour > 0) {
+        // Moving: wake again by the time we expect another significant change
+        nextInterval = clampInterval(config, config.significantDelta * 3600.0f / slopePerHour);
+    } else {
+        // Stable: back off
+        nextInterval = clampInterval(config, interval(config) * 2.0f);
+    }
+
+    lastTime = now;
+    lastRange = range;
+    return nextInterval;
+}
+
+uint32_t WakeScheduler::interval(const Config &config) const {
+    if (nextInterval == 0) {
+        return config.maxInterval;
+    }
+    return clampInterval(config, nextInterval);
+}
+
+float WakeScheduler::slope() const {
+    return slopePerHour;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+// Picks the next wake interval from how fast the range has been changing.
+// While the level is moving the interval is chosen so the expected change
+// until the next wake is about `significantDelta`. While it is stable the
+// interval doubles on every wake, up to `maxInterval`.
+// Has no constructor so an instance can be put in RTC memory, a zeroed
+// instance has no history and starts out at `maxInterval`.
+// Only depends on the C standard library so it can be built for the host.
+class WakeScheduler {
+   public:
+    struct Config {
+        uint32_t minInterval;       // Seconds
+        uint32_t maxInterval;       // Seconds
+        uint16_t significantDelta;  // Range change (mm) we want to catch
+    };
+
+    // Feeds a new range reading taken at `now` (seconds, monotonic) and
+    // returns the number of seconds until the next wake
+    uint32_t update(const Config &config, uint32_t now, uint16_t range);
+    // Seconds until the next wake, as returned by the last update()
+    uint32_t interval(const Config &config) const;
+    // Estimated rate of change in mm per hour
+    float slope() const;
+
+   private:
+    uint32_t lastTime;
+    uint16_t lastRange;
+    bool hasHistory;
+    float slopePerHour;
+    uint32_t nextInterval;
+};
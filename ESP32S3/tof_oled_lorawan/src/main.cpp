@@ -12,88 +12,157 @@
 // LIB RadioLib by Jan Gromes (https://github.com/jgromes/RadioLib)
 
 #include <Adafruit_GFX.h>
-#include <Adafruit_SSD1306.h>
 #include <Arduino.h>
+#include <BatteryMonitor.h>
+#include <DepthPayload.h>
+#include <I2CBus.h>
+#include <LinkTuner.h>
+#include <PartialSSD1306.h>
 #include <Preferences.h>
+#include <PowerDelay.h>
 #include <RadioLib.h>
+#include <RecordLog.h>
+#include <RemoteConfig.h>
+#include <SendPolicy.h>
+#include <WakeCycle.h>
+#include <WakeProfiler.h>
+#include <WakeScheduler.h>
 #include <Wire.h>
+#include <driver/rtc_io.h>
 #include <math.h>
 #include <secrets.h>
 
 // Function declarations
+void batteryTask(void *param);
+void sensorTask(void *param);
+void radioTask(void *param);
+void uiTask(void *param);
+bool waitForEvents(EventBits_t bits);
+bool wakeAborted();
+void finishTask(EventBits_t done);
+void abortWake();
+void showStatus(const __FlashStringHelper *msg);
 void showAppInfo();
 uint16_t readRangeWithRetries();
 uint16_t readRange();
 void showRange(uint16_t range);
 void showSubtext(const __FlashStringHelper *msg);
 void updatePayload(uint16_t range, uint16_t voltage);
-bool shouldSendPayload(uint16_t range, uint16_t voltage);
-bool sendRangeWithRetries(uint16_t range, uint16_t voltage);
-bool sendPayload(uint16_t range, uint16_t voltage);
+void lightSleep(uint32_t ms);
+bool sendPayload(const uint8_t *payload, size_t len, uint8_t port);
+void applyLinkSettings();
+void updateLinkSettings(int16_t state, bool linkCheck);
+void handleCommand(const uint8_t *buf, size_t len);
+void loadPolicy();
+void savePolicy();
+void applyPolicy();
+void saveLinkSettings();
+bool initRadio();
 bool joinNetwork();
+bool restoreSession();
+void saveNonces();
+void saveSession(bool persist);
+void forgetSession();
+void loadCounters();
+void flushCounters();
 void blink(int cnt, int time);
 void ledOn();
 void ledOff();
-void initDisplay();
+bool initDisplay();
 void enableDisplay();
 void disableDisplay();
+void flushDisplay();
 void clearDisplayBottom();
-void initToFSensor();
-void enableToFSensor();
-void disableToFSensor();
+bool initToFSensor();
 uint16_t measureBatteryVoltage(int pin);
+bool watchRange();
 void goToDeepSleep();
 
 const __FlashStringHelper *APP_NAME = F("Depth Sensor v0.5");
 
 Preferences preferences;
 
-Adafruit_SSD1306 display = Adafruit_SSD1306();
-bool displayAvailable = false;
-
-// #define USE_VL53L1X
-#define USE_SEN0590
-#if defined(USE_VL53L1X)
-
-#include <VL53L1X_DSensor.h>
-VL53L1X_DSensor dsensor;
+// The display and the distance sensor share the bus, each at its own clock
+I2CBus i2c;
 
-#elif defined(USE_SEN0590)
+// Status updates only send the rows that changed, in I2C fast mode
+const uint8_t DISPLAY_ADDRESS = 0x3C;
+const uint8_t DISPLAY_WIDTH = 128;
+const uint8_t DISPLAY_HEIGHT = 32;
+PartialSSD1306 display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+bool displayAvailable = false;
 
+// Either sensor can be fitted, the bus is probed on power on and after the
+// sensor failed. The result is kept in RTC memory for the other wakes.
+#include <DeviceRegistry.h>
 #include <SEN0590_DSensor.h>
-SEN0590_DSensor dsensor;
-
-#else
-
-#error "No distance sensor defined!"
-
-#endif
+#include <VL53L1X_DSensor.h>
+VL53L1X_DSensor vl53l1x(i2c);
+SEN0590_DSensor sen0590(i2c);
+const DeviceRegistry::Sensor SENSORS[] = {
+    {VL53L1X_DSensor::ADDRESS, &vl53l1x, "VL53L1X"},
+    {SEN0590::ADDRESS, &sen0590, "SEN0590"},
+};
+RTC_DATA_ATTR DeviceRegistry::Cache deviceCache;
+// Starts the VL53L1X with the shortest mode and timing budget that worked
+// on the last wake and only moves up when the reading is bad
+RTC_DATA_ATTR RangeTuner rangeTuner;
+const RangeTuner::Config RANGE_TUNING = {1.0f, 3.0f, 4.0f};
+DeviceRegistry devices(i2c, deviceCache, SENSORS, sizeof(SENSORS) / sizeof(SENSORS[0]), DISPLAY_ADDRESS);
+
+// Takes a short burst of readings so a single noisy one can't trigger an uplink
+#include <RangeFilter.h>
+const uint8_t RANGE_BURST_LENGTH = 5;
+RangeFilter<RANGE_BURST_LENGTH> dsensor(devices);
 
 const uint16_t RANGE_SIGNIFICANT_DELTA = 50;  // 5cm
 const uint16_t VOLTAGE_SIGNIFICANT_DELTA = 100; // 100mV
 const uint16_t BOOTCOUNT_SIGNIFICANT_DELTA = 30; // About 30 days
 
-const unsigned long DSLEEP_MAX_AWAKE_MS = 15000;
-const unsigned long DSLEEP_TIME_MS = 24LL * 60LL * 60LL * 1000LL; // Wake up every 24h
+const unsigned long DSLEEP_MAX_AWAKE_MS = 60000;  // Sleep anyway if the wake pipeline hangs
+const unsigned long ABORT_GRACE_MS = 10000;  // Long enough for the receive windows of a join
+const unsigned long DSLEEP_TIME_MS = 24LL * 60LL * 60LL * 1000LL; // Wake up at least every 24h
 //const unsigned long DSLEEP_TIME_MS = 10LL * 1000LL; // Wake up every 10s
+const unsigned long DSLEEP_MIN_TIME_MS = 15LL * 60LL * 1000LL; // But not more often than every 15m
 const int DSLEEP_WAKEUP_PIN = 21;  // User button on the Wio-SX1262 shield
 
+// A VL53L1X can keep ranging on its own during deep sleep and wake us
+// through its GPIO1 pin once the level leaves a band around the last
+// shared range. Timer wakes then only happen for the heartbeat, which
+// always sends.
+const bool RANGE_WATCH = true;
+const int RANGE_WATCH_PIN = D1;  // GPIO1 of the VL53L1X, active low
+const uint32_t RANGE_WATCH_PERIOD_MS = 30000;
+const uint32_t HEARTBEAT_DAYS = 7;
+bool rangeWake = false;  // Woken by the sensor
+
+// Wakes up more often while the level is changing and backs off while it's stable.
+// The intervals can be changed by a downlink, see applyPolicy().
+RTC_DATA_ATTR WakeScheduler wakeScheduler;
+WakeScheduler::Config wakeSchedule = {DSLEEP_MIN_TIME_MS / 1000, DSLEEP_TIME_MS / 1000, RANGE_SIGNIFICANT_DELTA};
+
 const int VMON_PIN = A0;  // Pin we're measuring battery voltage on
 uint16_t batterymv = 0;
-
-#if (SSD1306_LCDHEIGHT != 32)
-#error ("Height incorrect, please fix Adafruit_SSD1306.h!");
-#endif
+// We're measuring half the voltage, 256 samples take about 13ms
+BatteryMonitor battery(VMON_PIN, 2.0, 256);
+const uint32_t BATTERY_TIMEOUT_MS = 100;
+const uint16_t LOW_BATTERY_MV = 3400;  // Below this we save state on every wake
 
 // LoRaWan
 #define LORAWAN_UPLINK_USER_PORT 2
+// Uncomment to append the WakeProfiler summary byte of the previous wake to
+// every uplink. These are sent on their own port so the backend can tell them
+// apart from the plain payloads.
+// #define PROFILE_UPLINK
+#define LORAWAN_UPLINK_PROFILE_PORT 3
 
 // regional choices: EU868, US915, AU915, AS923, IN865, KR920, CN780, CN500
 const LoRaWANBand_t Region = EU868;
 const uint8_t subBand = 0;  // For US915 and AU915
 
 // SX1262 pin order: Module(NSS/CS, DIO1, RESET, BUSY);
-SX1262 radio = new Module(41, 39, 42, 40);
+const int RADIO_RESET_PIN = 42;
+SX1262 radio = new Module(41, 39, RADIO_RESET_PIN, 40);
 
 // create the LoRaWAN node
 LoRaWANNode node(&radio, &Region, subBand);
@@ -103,39 +172,164 @@ uint64_t devEUI = RADIOLIB_LORAWAN_DEV_EUI;
 uint8_t appKey[] = {RADIOLIB_LORAWAN_APP_KEY};
 uint8_t nwkKey[] = {RADIOLIB_LORAWAN_NWK_KEY};
 
+// LoRaWAN session state, kept in RTC memory so it survives deep sleep and
+// mirrored in NVS so it survives a power loss. This way we only need to do
+// a full OTAA join when there is no usable session.
+RTC_DATA_ATTR uint8_t lwNonces[RADIOLIB_LORAWAN_NONCES_BUF_SIZE];
+RTC_DATA_ATTR uint8_t lwSession[RADIOLIB_LORAWAN_SESSION_BUF_SIZE];
+RTC_DATA_ATTR bool lwNoncesValid = false;
+RTC_DATA_ATTR bool lwSessionValid = false;
+bool lwSessionRestored = false;
+
+// We pick the uplink data rate and TX power ourselves from the measured
+// link margin instead of relying on ADR, see LinkTuner. In EU868 DR0 is
+// SF12 and DR5 is SF7, the maximum EIRP is 16 dBm.
+RTC_DATA_ATTR LinkTuner linkTuner;
+RTC_DATA_ATTR bool linkTunerLoaded = false;
+const LinkTuner::Config LINK_TUNING = {
+    10,  // Target margin (dB)
+    0,   // DR0, SF12
+    5,   // DR5, SF7
+    3,   // Start at DR3, SF9
+    2,   // Min TX power (dBm)
+    16,  // Max TX power (dBm)
+    8,   // Link check every 8 uplinks
+};
+
 const unsigned int READ_MAX_RETRIES = 5;
 const unsigned int READ_RETRY_DELAY = 500;
 
 const unsigned int JOIN_MAX_RETRIES = 3;
 const unsigned int JOIN_RETRY_DELAY = 15000;
 
-const unsigned int SEND_MAX_RETRIES = 3;
+const unsigned int SEND_MAX_RETRIES = 6;
 const unsigned int SEND_RETRY_DELAY = 5000;
 
-const unsigned int PAYLOAD_VERSION = 3;
-
-// Non-volatile variables
-uint16_t bootCount;
-uint16_t lastSharedRange;
-uint16_t lastSharedVoltage;
-uint16_t lastBootCount;
+// Format used for single readings. DepthPayload::VERSION_PACKED saves 3
+// bytes per uplink, but only switch to it once the backend decoder knows
+// the format.
+const uint8_t PAYLOAD_VERSION = DepthPayload::VERSION_FIXED;
+
+// Readings that have not been sent yet, what the network has and the retry
+// state, all in RTC memory. Readings are sent together as a single uplink
+// once enough have been collected or when a significant change is seen.
+// Failed joins and uplinks are retried with an exponential backoff, each
+// against its own limit. Short backoffs are spent in light sleep, longer
+// ones end the wake and the retry is done in a wake of its own, without
+// taking a new measurement. The simulator runs the same WakeCycle.
+RTC_DATA_ATTR WakeCycle wakeCycle;
+const WakeCycle::Config WAKE_CYCLE = {
+    {JOIN_RETRY_DELAY, 60LL * 60LL * 1000LL, 25, JOIN_MAX_RETRIES},
+    {SEND_RETRY_DELAY, 10LL * 60LL * 1000LL, 25, SEND_MAX_RETRIES},
+    10000,  // Longest backoff (ms) spent in light sleep
+    PAYLOAD_VERSION,
+    LORAWAN_UPLINK_USER_PORT,
+#if defined(PROFILE_UPLINK)
+    LORAWAN_UPLINK_PROFILE_PORT,
+#else
+    0,
+#endif
+    HEARTBEAT_DAYS * 24 * 60 * 60,
+};
+const uint8_t READINGS_FLUSH_COUNT = 12;
+
+SendPolicy::Config sendPolicy = {RANGE_SIGNIFICANT_DELTA, VOLTAGE_SIGNIFICANT_DELTA, READINGS_FLUSH_COUNT, BOOTCOUNT_SIGNIFICANT_DELTA};
+
+// The wake intervals and the send thresholds can be changed with a
+// downlink on RemoteConfig::PORT. The result is acknowledged on the next
+// uplink, which is sent on the next wake. Kept in RTC memory and in NVS.
+const RemoteConfig::Settings DEFAULT_POLICY = {
+    DSLEEP_MIN_TIME_MS / 1000,
+    DSLEEP_TIME_MS / 1000,
+    RANGE_SIGNIFICANT_DELTA,
+    VOLTAGE_SIGNIFICANT_DELTA,
+    BOOTCOUNT_SIGNIFICANT_DELTA,
+};
+RTC_DATA_ATTR RemoteConfig::Settings policy;
+RTC_DATA_ATTR bool policyLoaded = false;
+// Sequence number of the last command applied, a repeat of it is only acked
+RTC_DATA_ATTR uint8_t appliedSeq = 0;
+
+// Wake pipeline: radio bring-up, range measurement, battery measurement
+// and the display each run in their own task and sync on the measured
+// values, so the wake takes about as long as the slowest stage instead
+// of the sum of all of them. The I2C bus and Serial have their own locks.
+const EventBits_t EV_BATTERY_READY = BIT0;
+const EventBits_t EV_RANGE_READY = BIT1;
+const EventBits_t EV_RADIO_DONE = BIT2;
+const EventBits_t EV_UI_DONE = BIT3;
+const EventBits_t EV_ALL_DONE = EV_BATTERY_READY | EV_RANGE_READY | EV_RADIO_DONE | EV_UI_DONE;
+// Set when the pipeline timed out, the tasks skip what is left and set
+// their done bit to acknowledge it
+const EventBits_t EV_ABORT = BIT4;
+
+const BaseType_t RADIO_CORE = 0;  // Arduino runs setup() and loop() on core 1
+const BaseType_t APP_CORE = 1;
+
+EventGroupHandle_t wakeEvents;
+TaskHandle_t radioHandle = NULL;
+TaskHandle_t sensorHandle = NULL;
+TaskHandle_t batteryHandle = NULL;
+TaskHandle_t uiHandle = NULL;
+// Done bits of the tasks that didn't acknowledge the abort and were
+// suspended, goToDeepSleep() leaves the peripherals they use alone
+EventBits_t stuckTasks = 0;
+QueueHandle_t statusQueue;
+bool wantDisplay = false;
+uint16_t measuredRange = IDistanceSensor::INVALID_RANGE;
+
+// Non-volatile variables, kept in RTC memory and only written to flash
+// every COUNTERS_FLUSH_WAKES wakes, or on every wake when the battery is low.
+// What was last shared is kept by wakeCycle.
+RTC_DATA_ATTR uint16_t bootCount;
+RTC_DATA_ATTR bool countersValid = false;
+RTC_DATA_ATTR uint16_t wakesSinceFlush;
+const uint16_t COUNTERS_FLUSH_WAKES = 16;
+
+// What gets written to flash
+struct CountersRecord {
+    uint16_t bootCount;
+    uint16_t lastSharedRange;
+    uint16_t lastSharedVoltage;
+    uint16_t lastBootCount;
+};
+RecordLog countersLog(preferences, "counters");
+
+// Time spent writing to NVS during this wake and since power on
+uint32_t nvsWriteUs = 0;
+RTC_DATA_ATTR uint64_t nvsWriteTotalUs;
+
+// Where the awake time goes, for the last few wakes. Dumped to Serial when
+// woken by the button.
+RTC_DATA_ATTR WakeProfiler profiler;
 
 void setup() {
     // Read non-volatile variables
+    profiler.start(WakeProfiler::PHASE_NVS);
     preferences.begin("depthsensor", false);
-    bootCount = preferences.getUInt("bootcount", 0);
-    lastSharedRange = preferences.getUInt("lastrange", IDistanceSensor::INVALID_RANGE);
-    lastSharedVoltage = preferences.getUInt("lastvoltage", 0);
-    lastBootCount = preferences.getUInt("lastbootcount", bootCount);
+    if (!countersValid) {
+        // RTC memory got wiped (power loss), get them from flash
+        loadCounters();
+    }
 
     // Update boot count
     bootCount++;
-    preferences.putUInt("bootcount", bootCount);
+    wakesSinceFlush++;
+    if (!policyLoaded) {
+        loadPolicy();
+    }
+    applyPolicy();
+    profiler.begin(bootCount);
+    profiler.stop(WakeProfiler::PHASE_NVS);
 
     esp_reset_reason_t reset_reason = esp_reset_reason();
     esp_sleep_wakeup_cause_t wakeup_cause = esp_sleep_get_wakeup_cause();
 
     Serial.begin(115200);
+    // The LED, the XSHUT line of the sensor and the I2C bus have to keep
+    // their state while we wait
+    static const uint8_t keepPins[] = {LED_BUILTIN, D7, SDA, SCL};
+    PowerDelay::begin(keepPins, sizeof(keepPins));
     blink(2, 300);
     Serial.println(F("===================="));
     Serial.println(F("Starting..."));
@@ -143,39 +337,215 @@ void setup() {
     Serial.println(reset_reason);
     Serial.print(F("Wakeup cause: "));
     Serial.println(wakeup_cause);
+    if (wakeup_cause == ESP_SLEEP_WAKEUP_EXT1) {
+        rangeWake = esp_sleep_get_ext1_wakeup_status() & (1ULL << RANGE_WATCH_PIN);
+    }
+    bool buttonWake = wakeup_cause == ESP_SLEEP_WAKEUP_EXT1 && !rangeWake;
+    if (buttonWake) {
+        profiler.dump(Serial);
+    } else if (rangeWake) {
+        Serial.println(F("INF: Level left the watched band"));
+    }
 
     // Set pin for voltage monitor
     pinMode(VMON_PIN, INPUT);
-    batterymv = measureBatteryVoltage(VMON_PIN);
 
-    Wire.begin();
+    // The only place the bus gets started
+    i2c.add(DISPLAY_ADDRESS, I2CBus::FAST, "SSD1306");
+    i2c.add(VL53L1X_DSensor::ADDRESS, VL53L1X_DSensor::MAX_CLOCK, "VL53L1X");
+    i2c.add(SEN0590::ADDRESS, SEN0590::MAX_CLOCK, "SEN0590");
+    i2c.begin();
+    vl53l1x.setTuner(rangeTuner, RANGE_TUNING);
 
-    if (reset_reason == ESP_RST_POWERON || (reset_reason == ESP_RST_DEEPSLEEP && wakeup_cause == ESP_SLEEP_WAKEUP_EXT1)) {
-        initDisplay();
+    if (reset_reason != ESP_RST_DEEPSLEEP) {
+        // Devices may have been swapped while the power was off
+        devices.forget();
+    }
+    if (devices.begin()) {
+        Serial.print(F("Probed sensor: "));
+        Serial.print(devices.sensorName());
+        Serial.print(F(", display: "));
+        Serial.println(devices.hasDisplay() ? F("yes") : F("no"));
     }
-    showAppInfo();
-    initToFSensor();
 
-    uint16_t range = readRangeWithRetries();
-    showRange(range);
-    if (range != IDistanceSensor::INVALID_RANGE) {
-        updatePayload(range, batterymv);
-        goToDeepSleep();
+    wantDisplay = devices.hasDisplay() && (reset_reason == ESP_RST_POWERON || (reset_reason == ESP_RST_DEEPSLEEP && buttonWake));
+    wakeCycle.begin(wakeup_cause == ESP_SLEEP_WAKEUP_TIMER);
+
+    wakeEvents = xEventGroupCreate();
+    statusQueue = xQueueCreate(8, sizeof(const __FlashStringHelper *));
+    // The radio, the sensor and the ADC must not be paused by light sleep
+    // in the waits of the UI, each task releases its hold when it's done
+    PowerDelay::hold();
+    xTaskCreatePinnedToCore(radioTask, "radio", 8192, NULL, 2, &radioHandle, RADIO_CORE);
+    if (wakeCycle.retryWake()) {
+        // Only here to retry the uplink, use the last reading
+        Serial.println(F("INF: Retry wake, not measuring"));
+        measuredRange = wakeCycle.readings().newest().range;
+        xEventGroupSetBits(wakeEvents, EV_RANGE_READY);
     } else {
-        // We were not able to get a good reading, going to sleep anyway
-        blink(3, 150);
+        PowerDelay::hold();
+        xTaskCreatePinnedToCore(sensorTask, "sensor", 4096, NULL, 2, &sensorHandle, APP_CORE);
+    }
+    PowerDelay::hold();
+    xTaskCreatePinnedToCore(batteryTask, "battery", 2048, NULL, 2, &batteryHandle, APP_CORE);
+    xTaskCreatePinnedToCore(uiTask, "ui", 4096, NULL, 1, &uiHandle, APP_CORE);
+
+    EventBits_t bits = xEventGroupWaitBits(wakeEvents, EV_ALL_DONE, pdFALSE, pdTRUE, pdMS_TO_TICKS(DSLEEP_MAX_AWAKE_MS));
+    if ((bits & EV_ALL_DONE) != EV_ALL_DONE) {
+        Serial.println(F("ERR: Wake pipeline timed out"));
+        abortWake();
     }
     goToDeepSleep();
 }
 
+// Asks the wake tasks to stop and waits for them to acknowledge. A task
+// that is stuck in a driver can't, it gets suspended so it can't touch its
+// peripheral while we shut down.
+void abortWake() {
+    xEventGroupSetBits(wakeEvents, EV_ABORT);
+    EventBits_t bits = xEventGroupWaitBits(wakeEvents, EV_ALL_DONE, pdFALSE, pdTRUE, pdMS_TO_TICKS(ABORT_GRACE_MS));
+    const struct {
+        TaskHandle_t handle;
+        EventBits_t done;
+        const char *name;
+    } tasks[] = {
+        {radioHandle, EV_RADIO_DONE, "radio"},
+        {sensorHandle, EV_RANGE_READY, "sensor"},
+        {batteryHandle, EV_BATTERY_READY, "battery"},
+        {uiHandle, EV_UI_DONE, "ui"},
+    };
+    for (const auto &task : tasks) {
+        // The done bit is set once the task stops, a handle without it is
+        // still running
+        if (task.handle != NULL && !(bits & task.done)) {
+            vTaskSuspend(task.handle);
+            stuckTasks |= task.done;
+            Serial.print(F("ERR: Suspended stuck task "));
+            Serial.println(task.name);
+        }
+    }
+}
+
+bool wakeAborted() {
+    return xEventGroupGetBits(wakeEvents) & EV_ABORT;
+}
+
+// Waits for all of `bits`, returns false if the wake was aborted first
+bool waitForEvents(EventBits_t bits) {
+    for (;;) {
+        EventBits_t set = xEventGroupWaitBits(wakeEvents, bits, pdFALSE, pdTRUE, pdMS_TO_TICKS(100));
+        if ((set & bits) == bits) {
+            return true;
+        }
+        if (set & EV_ABORT) {
+            return false;
+        }
+    }
+}
+
+// Reports a wake task as done and parks it. It isn't deleted, so its handle
+// stays valid for abortWake(). Deep sleep follows anyway.
+void finishTask(EventBits_t done) {
+    xEventGroupSetBits(wakeEvents, done);
+    vTaskSuspend(NULL);
+}
+
 void loop() {
     goToDeepSleep();
 }
 
+void batteryTask(void *param) {
+    // The ADC samples in the background while the sensor is measuring
+    if (battery.begin() && battery.measure(BATTERY_TIMEOUT_MS)) {
+        batterymv = battery.mean();
+        Serial.print(F("Battery mean/min (mV): "));
+        Serial.print(battery.mean());
+        Serial.print(F("/"));
+        Serial.println(battery.min());
+    } else {
+        Serial.println(F("ERR: Battery ADC continuous mode failed"));
+        battery.end();
+        batterymv = measureBatteryVoltage(VMON_PIN);
+    }
+    PowerDelay::release();
+    finishTask(EV_BATTERY_READY);
+}
+
+void sensorTask(void *param) {
+    profiler.start(WakeProfiler::PHASE_SENSOR);
+    bool sensorReady = initToFSensor();
+    profiler.stop(WakeProfiler::PHASE_SENSOR);
+    if (sensorReady) {
+        profiler.start(WakeProfiler::PHASE_RANGE);
+        measuredRange = readRangeWithRetries();
+        profiler.stop(WakeProfiler::PHASE_RANGE);
+        if (!devices.check()) {
+            Serial.println(F("ERR: Sensor bus errors, probing again on the next wake"));
+        }
+        if (measuredRange != IDistanceSensor::INVALID_RANGE) {
+            // The RTC clock keeps running during deep sleep
+            wakeScheduler.update(wakeSchedule, time(NULL), measuredRange);
+        }
+    } else {
+        showStatus(F("no sensor"));
+    }
+    PowerDelay::release();
+    finishTask(EV_RANGE_READY);
+}
+
+void radioTask(void *param) {
+    // Bring up the radio while the measurement is still running
+    profiler.start(WakeProfiler::PHASE_RADIO);
+    bool radioReady = initRadio();
+    profiler.stop(WakeProfiler::PHASE_RADIO);
+    if (!waitForEvents(EV_RANGE_READY | EV_BATTERY_READY)) {
+        Serial.println(F("ERR: Wake aborted, not sending"));
+    } else if (measuredRange == IDistanceSensor::INVALID_RANGE) {
+        // We were not able to get a good reading, going to sleep anyway
+        blink(3, 150);
+    } else if (radioReady) {
+        updatePayload(measuredRange, batterymv);
+    } else {
+        showStatus(F("radio fail"));
+    }
+    PowerDelay::release();
+    finishTask(EV_RADIO_DONE);
+}
+
+void uiTask(void *param) {
+    if (wantDisplay) {
+        profiler.start(WakeProfiler::PHASE_DISPLAY);
+        initDisplay();
+        profiler.stop(WakeProfiler::PHASE_DISPLAY);
+    }
+    if (waitForEvents(EV_BATTERY_READY)) {
+        showAppInfo();
+    }
+    if (waitForEvents(EV_RANGE_READY)) {
+        showRange(measuredRange);
+    }
+    // Show the progress reported by the other tasks until the radio is done
+    const __FlashStringHelper *msg;
+    while (!wakeAborted()) {
+        if (xQueueReceive(statusQueue, &msg, pdMS_TO_TICKS(100)) == pdTRUE) {
+            showSubtext(msg);
+        } else if (xEventGroupGetBits(wakeEvents) & EV_RADIO_DONE) {
+            break;
+        }
+    }
+    finishTask(EV_UI_DONE);
+}
+
+void showStatus(const __FlashStringHelper *msg) {
+    if (wantDisplay) {
+        xQueueSend(statusQueue, &msg, 0);
+    }
+}
+
 void showAppInfo() {
     Serial.println(APP_NAME);
     Serial.print(F("Last depth(mm): "));
-    Serial.println((int)round(lastSharedRange / 10.0));
+    Serial.println((int)round(wakeCycle.shared().range / 10.0));
     Serial.print(F("Boot count: "));
     Serial.println(bootCount);
     Serial.print(F("Battery(mV):"));
@@ -187,25 +557,26 @@ void showAppInfo() {
         display.setCursor(0, 0);
         display.println(APP_NAME);
         display.print(F("Last depth(mm): "));
-        display.println(lastSharedRange);
+        display.println(wakeCycle.shared().range);
         display.print(F("Boot count: "));
         display.println(bootCount);
         display.print(F("Battery(mV):"));
         display.println(batterymv);
-        display.display();
-        delay(3000);
+        flushDisplay();
+        sleepFor(3000);
     }
 }
 
 uint16_t readRangeWithRetries() {
     Serial.print(F("Read range tries: "));
     Serial.println(READ_MAX_RETRIES);
-    for (int i = 0; i < READ_MAX_RETRIES; i++) {
+    for (int i = 0; i < READ_MAX_RETRIES && !wakeAborted(); i++) {
         uint16_t range = readRange();
         if (range != IDistanceSensor::INVALID_RANGE) {
             return range;
         }
-        delay(READ_RETRY_DELAY);
+        profiler.retry(WakeProfiler::PHASE_RANGE);
+        sleepFor(READ_RETRY_DELAY);
     }
     return IDistanceSensor::INVALID_RANGE;
 }
@@ -217,7 +588,9 @@ uint16_t readRange() {
 void showRange(uint16_t range) {
     Serial.print(F("Measured range (mm): "));
     if (range != IDistanceSensor::INVALID_RANGE) {
-        Serial.println(range);
+        Serial.print(range);
+        Serial.print(F(", confidence(%): "));
+        Serial.println(dsensor.confidence());
     } else {
         Serial.println(F("NO DATA"));
     }
@@ -229,12 +602,12 @@ void showRange(uint16_t range) {
         if (range != IDistanceSensor::INVALID_RANGE) {
             display.print((int)round(range / 10.0));
             display.print("cm");
-            display.display();
-            delay(3000);
+            flushDisplay();
+            sleepFor(3000);
         } else {
             display.print("no data");
-            display.display();
-            delay(500);
+            flushDisplay();
+            sleepFor(500);
         }
     }
 }
@@ -246,98 +619,245 @@ void showSubtext(const __FlashStringHelper *msg) {
         display.setTextSize(1);
         display.setCursor(0, display.height() - 8);
         display.print(msg);
-        display.display();
-        delay(500);
+        flushDisplay();
+        sleepFor(500);
     }
 }
 
-void updatePayload(uint16_t range, uint16_t voltage) {
-    // check if the value actually changed enough
-    if (shouldSendPayload(range, voltage)) {
-        showSubtext(F("joining..."));
-        if (joinNetwork()) {
-            showSubtext(F("sending..."));
-            if (sendRangeWithRetries(range, voltage)) {
-                lastSharedRange = range;
-                lastSharedVoltage = voltage;
-                lastBootCount = bootCount;
-                preferences.putUInt("lastrange", lastSharedRange);
-                preferences.putUInt("lastvoltage", lastSharedVoltage);
-                preferences.putUInt("lastbootcount", lastBootCount);
-                showSubtext(F("send ok"));
-            } else {
-                showSubtext(F("send fail"));
-            }
+// The RadioLib side of an uplink, for WakeCycle
+class RadioLink : public WakeCycle::Link {
+   public:
+    bool join() {
+        showStatus(F("joining..."));
+        profiler.start(WakeProfiler::PHASE_JOIN);
+        bool joined = joinNetwork();
+        profiler.stop(WakeProfiler::PHASE_JOIN);
+        if (!joined) {
+            showStatus(F("join fail"));
+            profiler.retry(WakeProfiler::PHASE_JOIN);
+        }
+        return joined;
+    }
+
+    size_t maxPayloadLen() {
+        // Depends on the data rate of the next uplink
+        applyLinkSettings();
+        return node.getMaxPayloadLen();
+    }
+
+    bool send(const uint8_t *payload, size_t len, uint8_t port) {
+        showStatus(F("sending..."));
+        profiler.start(WakeProfiler::PHASE_SEND);
+        bool sent = sendPayload(payload, len, port);
+        profiler.stop(WakeProfiler::PHASE_SEND);
+        if (sent) {
+            blink(3, 300);
         } else {
-            showSubtext(F("join fail"));
+            Serial.println(F("ERR: Failed to send payload"));
+            profiler.retry(WakeProfiler::PHASE_SEND);
+            blink(2, 150);
         }
-    } else {
-        showSubtext(F("no change"));
-        blink(2, 300);
+        return sent;
     }
-}
 
-bool shouldSendPayload(uint16_t range, uint16_t voltage) {
-    // Check if the range value actually changed enough
-    if (lastSharedRange == IDistanceSensor::INVALID_RANGE || abs(lastSharedRange - range) >= RANGE_SIGNIFICANT_DELTA) {
-        Serial.println(F("INF: Range changed significantly, sending"));
-        return true;
+    void lightSleep(uint32_t ms) {
+        Serial.print(F("INF: Retrying soon (ms): "));
+        Serial.println(ms);
+        ::lightSleep(ms);
     }
-    // Do the same for the voltage
-    if (lastSharedVoltage == 0 || abs(lastSharedVoltage - voltage) >= VOLTAGE_SIGNIFICANT_DELTA) {
-        Serial.println(F("INF: Voltage changed significantly, sending"));
-        return true;
+
+    uint32_t random() {
+        return esp_random();
     }
-    // If we have booted more than a certain amount of times since the last send, send anyway
-    if (bootCount - lastBootCount >= BOOTCOUNT_SIGNIFICANT_DELTA) {
-        Serial.println(F("INF: Much time has passed since last update, sending"));
-        return true;
+
+    uint8_t profileSummary() {
+        return profiler.summary();
     }
-    Serial.println(F("INF: No significant changes, not sending"));
-    return false;
-}
 
-bool sendRangeWithRetries(uint16_t range, uint16_t voltage) {
-    for (int i = 0; i < SEND_MAX_RETRIES; i++) {
-        if (i > 0) {
-            Serial.println(F("ERR: Failed to send payload, retrying soon..."));
-            blink(2, 150);
-            delay(SEND_RETRY_DELAY);
+    bool aborted() {
+        return wakeAborted();
+    }
+};
+
+void updatePayload(uint16_t range, uint16_t voltage) {
+    if (!wakeCycle.retryWake()) {
+        // check if the value actually changed enough
+        SendPolicy::Reason reason;
+        bool send = wakeCycle.addReading(sendPolicy, {range, voltage, bootCount}, &reason);
+        Serial.print(F("INF: "));
+        Serial.println(SendPolicy::describe(reason));
+        if (!send) {
+            showStatus(F("no change"));
+            blink(2, 300);
+            return;
         }
-        if (sendPayload(range, voltage)) {
-            blink(3, 300);
-            return true;
-        };
+        if (reason == SendPolicy::NO_CHANGE) {
+            Serial.println(F("INF: Acknowledging command"));
+        }
+    }
+    RadioLink link;
+    switch (wakeCycle.send(WAKE_CYCLE, link)) {
+        case WakeCycle::SENT:
+            saveSession(true);
+            saveLinkSettings();
+            showStatus(F("send ok"));
+            break;
+        case WakeCycle::RETRY_LATER:
+            Serial.print(F("INF: Retrying in a later wake (ms): "));
+            Serial.println(wakeCycle.retryDelay());
+            if (lwSessionRestored) {
+                // The network might not know about our session anymore
+                forgetSession();
+            }
+            showStatus(F("retry later"));
+            break;
+        case WakeCycle::FAILED:
+            Serial.println(F("ERR: All attemps to send payload failed, aborting"));
+            blink(4, 150);
+            showStatus(F("send fail"));
+            break;
+        default:
+            showStatus(F("send fail"));
+            break;
     }
-    Serial.println(F("ERR: All attemps to send payload failed, aborting"));
-    blink(4, 150);
-    return false;
 }
 
-bool sendPayload(uint16_t range, uint16_t voltage) {
+void lightSleep(uint32_t ms) {
+    // Light sleep pauses the other core too. Taking the bus lets a display
+    // update the ui task is sending finish first, and keeps the next one
+    // from starting before the radio is back.
+    I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
+    // The radio keeps its configuration and wakes up again on the next
+    // command
+    radio.sleep();
+    // This task holds the chip awake for the radio, the other tasks' waits
+    // are let finish before sleeping
+    PowerDelay::sleepHeld(ms);
+}
+
+bool sendPayload(const uint8_t *payload, size_t len, uint8_t port) {
     Serial.println(F("INF: Attempting to send payload..."));
 
-    uint8_t uplinkPayload[7];
-    uplinkPayload[0] = PAYLOAD_VERSION;
-    uplinkPayload[1] = highByte(range);
-    uplinkPayload[2] = lowByte(range);
-    uplinkPayload[3] = highByte(voltage);
-    uplinkPayload[4] = lowByte(voltage);
-    uplinkPayload[5] = highByte(bootCount);
-    uplinkPayload[6] = lowByte(bootCount);
+    applyLinkSettings();
+    bool linkCheck = linkTuner.wantLinkCheck(LINK_TUNING);
+    if (linkCheck) {
+        // The answer comes in the downlink of this uplink
+        node.sendMacCommandReq(RADIOLIB_LORAWAN_MAC_LINK_CHECK);
+    }
 
-    int16_t state = node.sendReceive(uplinkPayload, sizeof(uplinkPayload), LORAWAN_UPLINK_USER_PORT);
-    if (state != RADIOLIB_ERR_NONE) {
+    // Measure the battery while it's under the load of the transmission
+    battery.startLoadMeasurement();
+    // Returns the number of the receive window if a downlink was received
+    uint8_t downlinkPayload[RADIOLIB_LORAWAN_MAX_DOWNLINK_SIZE];
+    size_t downlinkLen = 0;
+    LoRaWANEvent_t downlinkEvent;
+    int16_t state = node.sendReceive(payload, len, port, downlinkPayload, &downlinkLen, false, NULL, &downlinkEvent);
+    battery.stopLoadMeasurement();
+    Serial.print(F("Battery under load (mV): "));
+    Serial.println(battery.underLoad());
+    if (state < RADIOLIB_ERR_NONE) {
         Serial.print(F("ERR: Error sending payload: #"));
         Serial.println(state);
         return false;
     }
 
-    Serial.println(F("INF: Payload sent successfully"));
+    Serial.print(F("INF: Payload sent successfully, bytes: "));
+    Serial.println(len);
+    updateLinkSettings(state, linkCheck);
+    if (state > 0 && downlinkLen > 0 && downlinkEvent.fPort == RemoteConfig::PORT) {
+        handleCommand(downlinkPayload, downlinkLen);
+    }
     return true;
 }
 
-bool joinNetwork() {
+// Applies a policy change received in a downlink, the result goes out
+// with the next uplink
+void handleCommand(const uint8_t *buf, size_t len) {
+    uint8_t seq;
+    RemoteConfig::Status status = RemoteConfig::apply(buf, len, policy, appliedSeq, &seq);
+    Serial.print(F("INF: "));
+    Serial.print(RemoteConfig::describe(status));
+    Serial.print(F(", seq: "));
+    Serial.println(seq);
+    if (status == RemoteConfig::OK) {
+        appliedSeq = seq;
+        applyPolicy();
+        savePolicy();
+    }
+    wakeCycle.acknowledge(seq, status);
+}
+
+void loadPolicy() {
+    if (preferences.getBytes("policy", &policy, sizeof(policy)) != sizeof(policy) || !RemoteConfig::valid(policy)) {
+        policy = DEFAULT_POLICY;
+    }
+    appliedSeq = preferences.getUChar("policySeq", 0);
+    policyLoaded = true;
+}
+
+void savePolicy() {
+    uint32_t start = micros();
+    preferences.putBytes("policy", &policy, sizeof(policy));
+    preferences.putUChar("policySeq", appliedSeq);
+    nvsWriteUs += micros() - start;
+}
+
+void applyPolicy() {
+    wakeSchedule.minInterval = policy.minInterval;
+    wakeSchedule.maxInterval = policy.maxInterval;
+    wakeSchedule.significantDelta = policy.rangeDelta;
+    sendPolicy.rangeDelta = policy.rangeDelta;
+    sendPolicy.voltageDelta = policy.voltageDelta;
+    sendPolicy.bootDelta = policy.bootDelta;
+}
+
+void applyLinkSettings() {
+    node.setADR(false);
+    node.setDatarate(linkTuner.datarate(LINK_TUNING));
+    node.setTxPower(linkTuner.txPower(LINK_TUNING));
+}
+
+// `state` is what sendReceive() returned for an uplink that was sent
+void updateLinkSettings(int16_t state, bool linkCheck) {
+    linkTuner.uplinkSent();
+    if (state > 0) {
+        Serial.print(F("INF: Downlink SNR (dB): "));
+        Serial.print(radio.getSNR());
+        Serial.print(F(", RSSI (dBm): "));
+        Serial.println(radio.getRSSI());
+    }
+    uint8_t margin, gwCnt;
+    if (linkCheck && node.getMacLinkCheckAns(&margin, &gwCnt) == RADIOLIB_ERR_NONE) {
+        Serial.print(F("INF: Link margin (dB): "));
+        Serial.print(margin);
+        Serial.print(F(", gateways: "));
+        Serial.println(gwCnt);
+        linkTuner.linkCheck(LINK_TUNING, margin);
+    } else if (linkCheck) {
+        Serial.println(F("ERR: No answer to link check"));
+        linkTuner.linkCheckMissed(LINK_TUNING);
+    } else if (state == 1) {
+        // Downlinks in RX1 use the data rate of the uplink
+        linkTuner.downlink(LINK_TUNING, radio.getSNR());
+    }
+    if (linkTuner.changed()) {
+        Serial.print(F("INF: Next uplink DR/TX power (dBm): "));
+        Serial.print(linkTuner.datarate(LINK_TUNING));
+        Serial.print(F("/"));
+        Serial.println(linkTuner.txPower(LINK_TUNING));
+    }
+}
+
+void saveLinkSettings() {
+    if (linkTuner.changed()) {
+        uint32_t start = micros();
+        preferences.putBytes("lwlink", &linkTuner, sizeof(linkTuner));
+        nvsWriteUs += micros() - start;
+        linkTuner.clearChanged();
+    }
+}
+
+bool initRadio() {
     Serial.println(F("INF: Initialise the LoRaWan radio..."));
     blink(5, 50);
     int16_t state = radio.begin();
@@ -352,9 +872,31 @@ bool joinNetwork() {
 
     // Setup the OTAA session information
     node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+
+    if (!linkTunerLoaded) {
+        // RTC memory got wiped (power loss), try the copy in NVS
+        preferences.getBytes("lwlink", &linkTuner, sizeof(linkTuner));
+        linkTunerLoaded = true;
+    }
+
+    // Try to continue the previous session first, this saves a full join
+    lwSessionRestored = restoreSession();
+    if (lwSessionRestored) {
+        Serial.println(F("INF: LoRaWan session restored"));
+    }
+    return true;
+}
+
+bool joinNetwork() {
+    if (lwSessionRestored) {
+        return true;
+    }
+
     Serial.println(F("INF: Joining the LoRaWAN Network..."));
 
-    state = node.activateOTAA();
+    int16_t state = node.activateOTAA();
+    // The DevNonce was used up even if the join failed
+    saveNonces();
     if (state != RADIOLIB_LORAWAN_NEW_SESSION) {
         Serial.print(F("ERR: Failed to join LoRaWan network: #"));
         Serial.println(state);
@@ -362,25 +904,123 @@ bool joinNetwork() {
         return false;
     }
 
-    // Disable the ADR algorithm (on by default which is preferable)
-    // node.setADR(false);
-
-    // Set a fixed datarate
-    //  node.setDatarate(LORAWAN_UPLINK_DATA_RATE);
+    // Data rate and TX power are set before every uplink, see applyLinkSettings()
 
     // Manages uplink intervals to the TTN Fair Use Policy
     //  node.setDutyCycle(false);
 
     Serial.println(F("INF: LoRaWan network joined successfully"));
+    saveSession(true);
+    return true;
+}
+
+bool restoreSession() {
+    if (!lwNoncesValid) {
+        // RTC memory got wiped (power loss), try the copy in NVS
+        lwNoncesValid = preferences.getBytes("lwnonces", lwNonces, sizeof(lwNonces)) == sizeof(lwNonces);
+        lwSessionValid = lwNoncesValid && preferences.getBytes("lwsession", lwSession, sizeof(lwSession)) == sizeof(lwSession);
+    }
+    if (!lwNoncesValid) {
+        Serial.println(F("INF: No LoRaWan nonces stored, first join"));
+        return false;
+    }
+
+    int16_t state = node.setBufferNonces(lwNonces);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.print(F("ERR: Failed to restore LoRaWan nonces: #"));
+        Serial.println(state);
+        return false;
+    }
+    if (!lwSessionValid) {
+        Serial.println(F("INF: No LoRaWan session stored"));
+        return false;
+    }
+
+    state = node.setBufferSession(lwSession);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.print(F("ERR: Failed to restore LoRaWan session: #"));
+        Serial.println(state);
+        return false;
+    }
+    state = node.activateOTAA();
+    if (state != RADIOLIB_LORAWAN_SESSION_RESTORED) {
+        Serial.print(F("ERR: LoRaWan session was rejected: #"));
+        Serial.println(state);
+        return false;
+    }
     return true;
 }
 
+void saveNonces() {
+    memcpy(lwNonces, node.getBufferNonces(), sizeof(lwNonces));
+    lwNoncesValid = true;
+    uint32_t start = micros();
+    preferences.putBytes("lwnonces", lwNonces, sizeof(lwNonces));
+    nvsWriteUs += micros() - start;
+}
+
+void saveSession(bool persist) {
+    if (!node.isActivated()) {
+        return;
+    }
+    memcpy(lwSession, node.getBufferSession(), sizeof(lwSession));
+    lwSessionValid = true;
+    if (persist) {
+        // Only done after a join or a successful uplink to keep flash writes down
+        uint32_t start = micros();
+        preferences.putBytes("lwsession", lwSession, sizeof(lwSession));
+        nvsWriteUs += micros() - start;
+    }
+}
+
+void forgetSession() {
+    Serial.println(F("INF: Dropping LoRaWan session, will join again next time"));
+    lwSessionValid = false;
+    lwSessionRestored = false;
+    uint32_t start = micros();
+    preferences.remove("lwsession");
+    nvsWriteUs += micros() - start;
+}
+
+void loadCounters() {
+    CountersRecord record;
+    if (countersLog.load(&record, sizeof(record))) {
+        // We might have lost up to COUNTERS_FLUSH_WAKES boots since the
+        // last flush, skip ahead so the boot count never goes back
+        bootCount = record.bootCount + COUNTERS_FLUSH_WAKES;
+        wakeCycle.setShared({record.lastSharedRange, record.lastSharedVoltage, record.lastBootCount});
+    } else {
+        // Nothing logged yet, take the values stored by older firmware
+        bootCount = preferences.getUInt("bootcount", 0);
+        SendPolicy::Shared shared;
+        shared.range = preferences.getUInt("lastrange", IDistanceSensor::INVALID_RANGE);
+        shared.voltage = preferences.getUInt("lastvoltage", 0);
+        shared.bootCount = preferences.getUInt("lastbootcount", bootCount);
+        wakeCycle.setShared(shared);
+    }
+    countersValid = true;
+    // Make sure they get written on this first boot
+    wakesSinceFlush = COUNTERS_FLUSH_WAKES;
+}
+
+void flushCounters() {
+    const SendPolicy::Shared &shared = wakeCycle.shared();
+    CountersRecord record = {bootCount, shared.range, shared.voltage, shared.bootCount};
+    uint32_t start = micros();
+    if (countersLog.append(&record, sizeof(record))) {
+        wakesSinceFlush = 0;
+    } else {
+        Serial.println(F("ERR: Failed to store counters"));
+    }
+    nvsWriteUs += micros() - start;
+}
+
 void blink(int cnt, int time) {
     for (int i = 0; i < cnt; i++) {
         ledOn();
-        delay(time);
+        sleepFor(time);
         ledOff();
-        delay(time);
+        sleepFor(time);
     }
 }
 
@@ -396,13 +1036,15 @@ void ledOff() {
     digitalWrite(LED_BUILTIN, HIGH);
 }
 
-void initDisplay() {
+bool initDisplay() {
     // Initialize SSD1306 OLED display
     Serial.println(F("Display setup..."));
-    if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) {
+    I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
+    if (!display.begin(SSD1306_SWITCHCAPVCC, DISPLAY_ADDRESS)) {
         Serial.println(F("SSD1306 allocation failed"));
+        lock.fail();
         blink(7, 150);
-        goToDeepSleep();
+        return false;
     }
 
     enableDisplay();
@@ -414,11 +1056,13 @@ void initDisplay() {
     display.display();
 
     displayAvailable = true;
+    return true;
 }
 
 void enableDisplay() {
     if (displayAvailable) {
         // Turn display on
+        I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
         display.ssd1306_command(SSD1306_DISPLAYON);
     }
 }
@@ -426,32 +1070,33 @@ void enableDisplay() {
 void disableDisplay() {
     if (displayAvailable) {
         // Turn display off
+        I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
         display.ssd1306_command(SSD1306_DISPLAYOFF);
     }
 }
 
+void flushDisplay() {
+    I2CBus::Lock lock(i2c, DISPLAY_ADDRESS);
+    display.update();
+}
+
 void clearDisplayBottom() {
     if (displayAvailable) {
         int16_t h = display.height();
         display.fillRect(0, h - 8, display.width(), 8, BLACK);
-        display.display();
     }
 }
 
-void initToFSensor() {
-    // Initialize VL53L1X time-of-flight sensor
-    Serial.println(F("Time-of-flight sensor setup..."));
+bool initToFSensor() {
+    // Initialize the sensor the registry found
+    Serial.print(F("Distance sensor setup: "));
+    Serial.println(devices.sensorName());
     if (!dsensor.init()) {
-        Serial.println(F("Failed to detect/init VL53L1X"));
-        if (displayAvailable) {
-            display.clearDisplay();
-            display.setCursor(0, 0);
-            display.print("No Sensor!");
-            display.display();
-        }
+        Serial.println(F("Failed to detect/init the distance sensor"));
         blink(8, 150);
-        goToDeepSleep();
+        return false;
     }
+    return true;
 }
 
 uint16_t measureBatteryVoltage(int pin) {
@@ -464,17 +1109,91 @@ uint16_t measureBatteryVoltage(int pin) {
     return Vbatt;
 }
 
+// Lets the sensor watch the level while we sleep. The band is around the
+// last shared range, or around this wake's reading if that is already
+// outside of it (the uplink failed), so we don't wake again right away.
+// The band is the range change worth sending.
+bool watchRange() {
+    uint16_t low, high;
+    if (!wakeCycle.watchBand(sendPolicy.rangeDelta, measuredRange, &low, &high)) {
+        return false;
+    }
+    if (!dsensor.watch(low, high, RANGE_WATCH_PERIOD_MS)) {
+        return false;
+    }
+    Serial.print(F("Watching range (mm): "));
+    Serial.print(low);
+    Serial.print(F("-"));
+    Serial.println(high);
+    return true;
+}
+
 void goToDeepSleep() {
-    disableDisplay();
-    dsensor.disable();
-    radio.sleep();
-    // Configure deep sleep wake-up timer
-    esp_sleep_enable_timer_wakeup(DSLEEP_TIME_MS * 1000LL);
-    // Configure deep sleep wake-up button
-    esp_sleep_enable_ext1_wakeup(1ULL << DSLEEP_WAKEUP_PIN, ESP_EXT1_WAKEUP_ANY_LOW);
+    // A suspended task may still hold the lock of the bus or be in the
+    // middle of a radio or NVS operation, skip what would need it
+    const bool busFree = !(stuckTasks & (EV_RANGE_READY | EV_UI_DONE));
+    const bool radioFree = !(stuckTasks & EV_RADIO_DONE);
+    bool watching = false;
+    if (busFree) {
+        disableDisplay();
+        watching = RANGE_WATCH && watchRange();
+        // Keeps the sensor configured for the next wake if it can
+        dsensor.suspend();
+    }
+    // Keep the frame counters of the current session for the next wake
+    if (radioFree) {
+        if (lwSessionValid) {
+            saveSession(false);
+        }
+        radio.sleep();
+    } else {
+        // The SPI bus may be locked, a reset at least gets the radio out of
+        // transmit or receive and into standby
+        pinMode(RADIO_RESET_PIN, OUTPUT);
+        digitalWrite(RADIO_RESET_PIN, LOW);
+        delayMicroseconds(200);
+        digitalWrite(RADIO_RESET_PIN, HIGH);
+    }
+    if (!(stuckTasks & EV_BATTERY_READY)) {
+        battery.end();
+    }
+    // The voltage under load is the best sign of an empty battery
+    uint16_t lowestmv = battery.underLoad() ? battery.underLoad() : batterymv;
+    profiler.start(WakeProfiler::PHASE_NVS);
+    if (radioFree && (wakesSinceFlush >= COUNTERS_FLUSH_WAKES || (lowestmv > 0 && lowestmv < LOW_BATTERY_MV))) {
+        flushCounters();
+    }
+    nvsWriteTotalUs += nvsWriteUs;
+    // Configure deep sleep wake-up timer, a pending retry comes first and
+    // while the sensor watches the level it's only for the heartbeat
+    uint64_t sleepTimeUs = wakeCycle.sleepTime(WAKE_CYCLE, wakeScheduler, wakeSchedule, watching) * 1000ULL;
+    uint64_t wakePins = 1ULL << DSLEEP_WAKEUP_PIN;
+    if (watching) {
+        // GPIO1 is open drain, the RTC domain keeps the pull-up on
+        rtc_gpio_pullup_en((gpio_num_t)RANGE_WATCH_PIN);
+        rtc_gpio_pulldown_dis((gpio_num_t)RANGE_WATCH_PIN);
+        esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+        wakePins |= 1ULL << RANGE_WATCH_PIN;
+    }
+    Serial.print(F("Next wake (s): "));
+    Serial.print((uint32_t)(sleepTimeUs / 1000000LL));
+    Serial.print(F(", slope (mm/h): "));
+    Serial.println(wakeScheduler.slope());
+    esp_sleep_enable_timer_wakeup(sleepTimeUs);
+    // Configure deep sleep wake-up button (and the sensor)
+    esp_sleep_enable_ext1_wakeup(wakePins, ESP_EXT1_WAKEUP_ANY_LOW);
     // Store non-volatile variables
-    preferences.end();
+    if (radioFree) {
+        preferences.end();
+    }
+    profiler.stop(WakeProfiler::PHASE_NVS);
+    profiler.end();
     // Close down Serial
+    Serial.print(F("NVS write time (us): "));
+    Serial.print(nvsWriteUs);
+    Serial.print(F(", total: "));
+    Serial.println(nvsWriteTotalUs);
+    i2c.printStats(Serial);
     Serial.println(F("Sleeping..."));
     Serial.flush();
     Serial.end();
@@ -0,0 +1,286 @@
+// Host tests for the DepthPayload codec, run with: pio test -e native
+
+#include <DepthPayload.h>
+#include <stdio.h>
+#include <time.h>
+#include <unity.h>
+
+namespace {
+
+// Small deterministic generator so failures can be reproduced
+uint32_t rngState;
+
+void seed(uint32_t value) {
+    rngState = value;
+}
+
+uint32_t next() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+DepthReading randomReading() {
+    DepthReading r;
+    r.range = next();
+    r.voltage = next();
+    r.bootCount = next();
+    return r;
+}
+
+void assertReading(const DepthReading &expected, const DepthReading &actual) {
+    TEST_ASSERT_EQUAL_UINT16(expected.range, actual.range);
+    TEST_ASSERT_EQUAL_UINT16(expected.voltage, actual.voltage);
+    TEST_ASSERT_EQUAL_UINT16(expected.bootCount, actual.bootCount);
+}
+
+// Encodes with `version`, decodes and compares, taking the voltage
+// quantization of the packed format into account
+void assertRoundTrip(uint8_t version, const DepthReading &reading) {
+    uint8_t buf[DepthPayload::MAX_SIZE];
+    size_t len = DepthPayload::encode(version, reading, buf, sizeof(buf));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    DepthReading decoded[2];
+    TEST_ASSERT_EQUAL_UINT8(1, DepthPayload::decode(buf, len, decoded, 2));
+    DepthReading expected = reading;
+    if (version == DepthPayload::VERSION_PACKED) {
+        expected.voltage = DepthPayload::packedVoltage(reading.voltage);
+    }
+    assertReading(expected, decoded[0]);
+}
+
+}  // namespace
+
+void setUp() {
+    seed(0x2545F491);
+}
+
+void tearDown() {
+}
+
+void test_fixed_layout() {
+    DepthReading reading = {0x1234, 0x0E74, 0xBEEF};
+    uint8_t buf[DepthPayload::FIXED_SIZE];
+    const uint8_t expected[] = {3, 0x12, 0x34, 0x0E, 0x74, 0xBE, 0xEF};
+    TEST_ASSERT_EQUAL_size_t(DepthPayload::FIXED_SIZE, DepthPayload::encodeFixed(reading, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_fixed_round_trip_boundaries() {
+    const DepthReading readings[] = {
+        {0, 0, 0},
+        {0xFFFF, 0xFFFF, 0xFFFF},
+        {2047, 2000, 1023},
+        {2048, 4520, 1024},
+    };
+    for (const DepthReading &r : readings) {
+        assertRoundTrip(DepthPayload::VERSION_FIXED, r);
+    }
+}
+
+void test_fixed_rejects_bad_lengths() {
+    DepthReading reading = {1000, 3700, 42};
+    uint8_t buf[DepthPayload::FIXED_SIZE + 1] = {};
+    DepthReading decoded[1];
+    TEST_ASSERT_EQUAL_size_t(0, DepthPayload::encodeFixed(reading, buf, DepthPayload::FIXED_SIZE - 1));
+    DepthPayload::encodeFixed(reading, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, DepthPayload::FIXED_SIZE - 1, decoded, 1));
+    TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, DepthPayload::FIXED_SIZE + 1, decoded, 1));
+}
+
+void test_packed_round_trip_boundaries() {
+    const DepthReading readings[] = {
+        {0, 0, 0},
+        {2047, 2000, 1023},
+        {2048, 2040, 1024},
+        {0xFFFF, 0xFFFF, 0xFFFF},
+        {1, 4520, 1},
+        {1500, 3700, 500},
+    };
+    for (const DepthReading &r : readings) {
+        assertRoundTrip(DepthPayload::VERSION_PACKED, r);
+    }
+}
+
+void test_packed_sizes() {
+    uint8_t buf[DepthPayload::MAX_SIZE];
+    DepthReading typical = {1500, 3700, 500};
+    DepthReading largest = {0xFFFF, 0xFFFF, 0xFFFF};
+    TEST_ASSERT_EQUAL_size_t(4, DepthPayload::encodePacked(typical, buf, sizeof(buf)));
+    size_t len = DepthPayload::encodePacked(largest, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_size_t(6, len);
+    TEST_ASSERT_LESS_OR_EQUAL(DepthPayload::MAX_PACKED_SIZE, len);
+    // First byte can't be taken for one of the byte-aligned versions
+    TEST_ASSERT_EQUAL_HEX8(0xA0, buf[0] & 0xE0);
+}
+
+void test_packed_voltage_quantization() {
+    TEST_ASSERT_EQUAL_UINT16(0, DepthPayload::packedVoltage(0));
+    TEST_ASSERT_EQUAL_UINT16(2040, DepthPayload::packedVoltage(1));
+    TEST_ASSERT_EQUAL_UINT16(3720, DepthPayload::packedVoltage(3700));
+    TEST_ASSERT_EQUAL_UINT16(4520, DepthPayload::packedVoltage(0xFFFF));
+    for (uint32_t mv = 2040; mv <= 4520; mv++) {
+        TEST_ASSERT_UINT_WITHIN(20, mv, DepthPayload::packedVoltage(mv));
+    }
+}
+
+void test_packed_rejects_bad_lengths() {
+    DepthReading reading = {1500, 3700, 500};
+    uint8_t buf[DepthPayload::MAX_SIZE] = {};
+    DepthReading decoded[1];
+    size_t len = DepthPayload::encodePacked(reading, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_size_t(0, DepthPayload::encodePacked(reading, buf, len - 1));
+    len = DepthPayload::encodePacked(reading, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, len - 1, decoded, 1));
+    TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, len + 1, decoded, 1));
+}
+
+void test_batch_round_trip() {
+    const DepthReading readings[] = {
+        {1000, 3700, 10},
+        {1000, 3700, 11},
+        {0, 0, 12},
+        {0xFFFF, 0xFFFF, 0xFFFF},
+        {500, 3300, 3},  // Boot count wrapped
+    };
+    const uint8_t cnt = sizeof(readings) / sizeof(readings[0]);
+    uint8_t buf[DepthPayload::MAX_SIZE];
+    uint8_t used;
+    size_t len = DepthPayload::encodeBatch(readings, cnt, buf, sizeof(buf), &used);
+    TEST_ASSERT_EQUAL_UINT8(cnt, used);
+    DepthReading decoded[cnt];
+    TEST_ASSERT_EQUAL_UINT8(cnt, DepthPayload::decode(buf, len, decoded, cnt));
+    for (uint8_t i = 0; i < cnt; i++) {
+        assertReading(readings[i], decoded[i]);
+    }
+}
+
+void test_batch_splits_when_full() {
+    DepthReading readings[16];
+    for (uint8_t i = 0; i < 16; i++) {
+        readings[i] = randomReading();
+    }
+    uint8_t buf[DepthPayload::MAX_SIZE];
+    uint8_t used;
+    size_t len = DepthPayload::encodeBatch(readings, 16, buf, 20, &used);
+    TEST_ASSERT_LESS_OR_EQUAL(20, len);
+    TEST_ASSERT_GREATER_THAN(0, used);
+    TEST_ASSERT_LESS_THAN(16, used);
+    DepthReading decoded[16];
+    TEST_ASSERT_EQUAL_UINT8(used, DepthPayload::decode(buf, len, decoded, 16));
+    for (uint8_t i = 0; i < used; i++) {
+        assertReading(readings[i], decoded[i]);
+    }
+}
+
+void test_batch_rejects_bad_lengths() {
+    const DepthReading readings[] = {{1000, 3700, 10}, {1010, 3690, 11}, {990, 3680, 12}};
+    uint8_t buf[DepthPayload::MAX_SIZE] = {};
+    uint8_t used;
+    DepthReading decoded[3];
+    TEST_ASSERT_EQUAL_size_t(0, DepthPayload::encodeBatch(readings, 3, buf, 7, &used));
+    TEST_ASSERT_EQUAL_UINT8(0, used);
+    size_t len = DepthPayload::encodeBatch(readings, 3, buf, sizeof(buf), &used);
+    for (size_t cut = 0; cut < len; cut++) {
+        TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, cut, decoded, 3));
+    }
+    TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, len + 1, decoded, 3));
+    // More readings than the caller has room for
+    TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, len, decoded, 2));
+}
+
+void test_unknown_version() {
+    uint8_t buf[] = {9, 0, 0, 0, 0, 0, 0};
+    DepthReading decoded[1];
+    TEST_ASSERT_EQUAL_UINT8(0, DepthPayload::decode(buf, sizeof(buf), decoded, 1));
+    DepthReading reading = {1, 2, 3};
+    TEST_ASSERT_EQUAL_size_t(0, DepthPayload::encode(DepthPayload::VERSION_BATCH, reading, buf, sizeof(buf)));
+}
+
+void test_fuzz_round_trip() {
+    for (int i = 0; i < 20000; i++) {
+        DepthReading r = randomReading();
+        assertRoundTrip(DepthPayload::VERSION_FIXED, r);
+        assertRoundTrip(DepthPayload::VERSION_PACKED, r);
+    }
+    for (int i = 0; i < 2000; i++) {
+        DepthReading readings[16];
+        uint8_t cnt = 1 + next() % 16;
+        for (uint8_t j = 0; j < cnt; j++) {
+            readings[j] = randomReading();
+        }
+        uint8_t buf[DepthPayload::MAX_SIZE];
+        uint8_t used;
+        size_t len = DepthPayload::encodeBatch(readings, cnt, buf, sizeof(buf), &used);
+        DepthReading decoded[16];
+        TEST_ASSERT_EQUAL_UINT8(used, DepthPayload::decode(buf, len, decoded, 16));
+        for (uint8_t j = 0; j < used; j++) {
+            assertReading(readings[j], decoded[j]);
+        }
+    }
+}
+
+void test_fuzz_decode_garbage() {
+    // Anything that decodes has to encode back to the same bytes
+    for (int i = 0; i < 200000; i++) {
+        uint8_t buf[DepthPayload::MAX_SIZE];
+        size_t len = next() % (sizeof(buf) + 1);
+        for (size_t j = 0; j < len; j++) {
+            buf[j] = next();
+        }
+        if (len > 0 && next() % 2) {
+            // Make the known versions more likely
+            const uint8_t versions[] = {DepthPayload::VERSION_FIXED, DepthPayload::VERSION_BATCH, 0xA0};
+            uint8_t version = versions[next() % 3];
+            buf[0] = version == 0xA0 ? (0xA0 | (buf[0] & 0x1F)) : version;
+        }
+        DepthReading decoded[16];
+        uint8_t cnt = DepthPayload::decode(buf, len, decoded, 16);
+        TEST_ASSERT_LESS_OR_EQUAL(16, cnt);
+        if (cnt == 1 && buf[0] == DepthPayload::VERSION_FIXED) {
+            uint8_t again[DepthPayload::FIXED_SIZE];
+            DepthPayload::encodeFixed(decoded[0], again, sizeof(again));
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(buf, again, sizeof(again));
+        }
+    }
+}
+
+void test_throughput() {
+    const int count = 1000000;
+    uint8_t buf[DepthPayload::MAX_PACKED_SIZE];
+    DepthReading decoded[1];
+    size_t bytes = 0;
+    clock_t start = clock();
+    for (int i = 0; i < count; i++) {
+        // Ranges up to 2 m and up to 1024 wakes since power on
+        DepthReading r = {(uint16_t)(next() % 2048), (uint16_t)(3300 + next() % 900), (uint16_t)(i % 1024)};
+        size_t len = DepthPayload::encodePacked(r, buf, sizeof(buf));
+        bytes += len;
+        TEST_ASSERT_EQUAL_UINT8(1, DepthPayload::decode(buf, len, decoded, 1));
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    char msg[128];
+    snprintf(msg, sizeof(msg), "packed: %.2f bytes/reading, %.0f round trips/s", (double)bytes / count, count / seconds);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_size_t(4 * (size_t)count, bytes);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_layout);
+    RUN_TEST(test_fixed_round_trip_boundaries);
+    RUN_TEST(test_fixed_rejects_bad_lengths);
+    RUN_TEST(test_packed_round_trip_boundaries);
+    RUN_TEST(test_packed_sizes);
+    RUN_TEST(test_packed_voltage_quantization);
+    RUN_TEST(test_packed_rejects_bad_lengths);
+    RUN_TEST(test_batch_round_trip);
+    RUN_TEST(test_batch_splits_when_full);
+    RUN_TEST(test_batch_rejects_bad_lengths);
+    RUN_TEST(test_unknown_version);
+    RUN_TEST(test_fuzz_round_trip);
+    RUN_TEST(test_fuzz_decode_garbage);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,267 @@
+// Host tests for WakeCycle, run with: pio test -e native
+
+#include <RemoteConfig.h>
+#include <WakeCycle.h>
+#include <unity.h>
+
+#include <vector>
+
+namespace {
+
+const SendPolicy::Config POLICY = {50, 100, 12, 30};
+const WakeScheduler::Config SCHEDULE = {15 * 60, 24 * 60 * 60, 50};
+const WakeCycle::Config CONFIG = {
+    {15000, 60UL * 60 * 1000, 0, 3},
+    {5000, 10UL * 60 * 1000, 0, 6},
+    10000,
+    DepthPayload::VERSION_FIXED,
+    2,
+    0,
+    7 * 24 * 60 * 60,
+};
+
+// Network that answers from a script, true is a join or uplink that works
+class FakeLink : public WakeCycle::Link {
+   public:
+    FakeLink() : maxLen(51), joined(false), sleptMs(0), cycle(NULL), command(false) {}
+
+    bool join() {
+        if (joined) {
+            return true;
+        }
+        joined = next(joins);
+        return joined;
+    }
+
+    size_t maxPayloadLen() { return maxLen; }
+
+    bool send(const uint8_t *payload, size_t len, uint8_t port) {
+        if (!next(sends)) {
+            return false;
+        }
+        uplinks.push_back(std::vector<uint8_t>(payload, payload + len));
+        ports.push_back(port);
+        if (command) {
+            // A downlink with a command in it
+            cycle->acknowledge(9, RemoteConfig::OK);
+            command = false;
+        }
+        return true;
+    }
+
+    void lightSleep(uint32_t ms) { sleptMs += ms; }
+    uint32_t random() { return 0; }
+
+    size_t maxLen;
+    bool joined;
+    std::vector<bool> joins;
+    std::vector<bool> sends;
+    std::vector<std::vector<uint8_t>> uplinks;
+    std::vector<uint8_t> ports;
+    uint32_t sleptMs;
+    WakeCycle *cycle;
+    bool command;
+
+   private:
+    static bool next(std::vector<bool> &script) {
+        if (script.empty()) {
+            return true;
+        }
+        bool result = script.front();
+        script.erase(script.begin());
+        return result;
+    }
+};
+
+WakeCycle cycle;
+
+void startWake(bool timerWake) {
+    cycle.begin(timerWake);
+}
+
+}  // namespace
+
+void setUp() {
+    cycle = WakeCycle();
+    cycle.setShared({SendPolicy::NO_RANGE, 0, 0});
+}
+
+void tearDown() {
+}
+
+void test_first_reading_sent_fixed() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    TEST_ASSERT_TRUE(cycle.addReading(POLICY, {1000, 4000, 1}, &reason));
+    TEST_ASSERT_EQUAL(SendPolicy::RANGE_CHANGED, reason);
+    TEST_ASSERT_EQUAL(WakeCycle::SENT, cycle.send(CONFIG, link));
+    TEST_ASSERT_EQUAL(1, link.uplinks.size());
+    TEST_ASSERT_EQUAL_UINT8(2, link.ports[0]);
+    TEST_ASSERT_EQUAL(DepthPayload::FIXED_SIZE, link.uplinks[0].size());
+    TEST_ASSERT_EQUAL_UINT8(DepthPayload::VERSION_FIXED, link.uplinks[0][0]);
+    TEST_ASSERT_EQUAL_UINT16(1000, cycle.shared().range);
+    TEST_ASSERT_EQUAL_UINT8(0, cycle.readings().count());
+}
+
+void test_small_change_buffered() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    cycle.addReading(POLICY, {1000, 4000, 1}, &reason);
+    cycle.send(CONFIG, link);
+    startWake(false);
+    TEST_ASSERT_FALSE(cycle.addReading(POLICY, {1020, 4000, 2}, &reason));
+    TEST_ASSERT_EQUAL(SendPolicy::NO_CHANGE, reason);
+    TEST_ASSERT_EQUAL_UINT8(1, cycle.readings().count());
+    // The next big change sends both as a batch
+    startWake(false);
+    TEST_ASSERT_TRUE(cycle.addReading(POLICY, {1100, 4000, 3}, &reason));
+    TEST_ASSERT_EQUAL(WakeCycle::SENT, cycle.send(CONFIG, link));
+    TEST_ASSERT_EQUAL_UINT8(DepthPayload::VERSION_BATCH, link.uplinks[1][0]);
+    TEST_ASSERT_EQUAL_UINT16(1100, cycle.shared().range);
+}
+
+void test_baseline_from_last_reading_sent() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    for (uint16_t i = 0; i < 12; i++) {
+        cycle.addReading(POLICY, {(uint16_t)(1000 + i), 4000, i}, &reason);
+    }
+    // Room for part of the batch only
+    link.maxLen = 16;
+    TEST_ASSERT_EQUAL(WakeCycle::SENT, cycle.send(CONFIG, link));
+    uint8_t left = cycle.readings().count();
+    TEST_ASSERT_GREATER_THAN(0, left);
+    TEST_ASSERT_EQUAL_UINT16(cycle.readings().at(0).range - 1, cycle.shared().range);
+}
+
+void test_ack_in_front_and_kept_on_failure() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    cycle.addReading(POLICY, {1000, 4000, 1}, &reason);
+    cycle.send(CONFIG, link);
+    cycle.acknowledge(7, RemoteConfig::OUT_OF_RANGE);
+
+    // No change, but the acknowledgement has to go out
+    startWake(false);
+    TEST_ASSERT_TRUE(cycle.addReading(POLICY, {1001, 4000, 2}, &reason));
+    TEST_ASSERT_EQUAL(SendPolicy::NO_CHANGE, reason);
+    link.sends = {false};
+    TEST_ASSERT_EQUAL(WakeCycle::SENT, cycle.send(CONFIG, link));
+    TEST_ASSERT_EQUAL_UINT32(5000, link.sleptMs);
+    TEST_ASSERT_EQUAL_UINT8(RemoteConfig::PORT, link.ports[1]);
+    TEST_ASSERT_EQUAL_UINT8(7, link.uplinks[1][0]);
+    TEST_ASSERT_EQUAL_UINT8(RemoteConfig::OUT_OF_RANGE, link.uplinks[1][1]);
+    TEST_ASSERT_EQUAL(RemoteConfig::ACK_SIZE + DepthPayload::FIXED_SIZE, link.uplinks[1].size());
+    TEST_ASSERT_FALSE(cycle.ackPending());
+}
+
+void test_command_in_ack_downlink_stays_pending() {
+    FakeLink link;
+    link.cycle = &cycle;
+    SendPolicy::Reason reason;
+    startWake(false);
+    cycle.addReading(POLICY, {1000, 4000, 1}, &reason);
+    cycle.acknowledge(8, RemoteConfig::OK);
+    link.command = true;
+    TEST_ASSERT_EQUAL(WakeCycle::SENT, cycle.send(CONFIG, link));
+    TEST_ASSERT_EQUAL_UINT8(RemoteConfig::PORT, link.ports[0]);
+    TEST_ASSERT_TRUE(cycle.ackPending());
+}
+
+void test_join_and_send_budgets_apart() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    cycle.addReading(POLICY, {1000, 4000, 1}, &reason);
+    WakeCycle::Config config = CONFIG;
+    config.sendBackoff.maxAttempts = 3;
+    config.lightSleepMax = 0xffffffff;
+    // Failed joins don't use up the attempts of the uplink
+    link.joins = {false, false, true};
+    link.sends = {false, false, true};
+    TEST_ASSERT_EQUAL(WakeCycle::SENT, cycle.send(config, link));
+    TEST_ASSERT_EQUAL_UINT32(0, cycle.retryDelay());
+}
+
+void test_long_backoff_retried_in_own_wake() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    cycle.addReading(POLICY, {1000, 4000, 1}, &reason);
+    link.joins = {false};
+    TEST_ASSERT_EQUAL(WakeCycle::RETRY_LATER, cycle.send(CONFIG, link));
+    TEST_ASSERT_EQUAL_UINT32(15000, cycle.retryDelay());
+    WakeScheduler scheduler = {};
+    TEST_ASSERT_EQUAL_UINT64(15000, cycle.sleepTime(CONFIG, scheduler, SCHEDULE, false));
+
+    startWake(true);
+    TEST_ASSERT_TRUE(cycle.retryWake());
+    TEST_ASSERT_FALSE(cycle.heartbeatWake());
+    TEST_ASSERT_EQUAL(WakeCycle::SENT, cycle.send(CONFIG, link));
+    TEST_ASSERT_EQUAL_UINT64(SCHEDULE.maxInterval * 1000ULL, cycle.sleepTime(CONFIG, scheduler, SCHEDULE, false));
+}
+
+void test_gives_up() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    cycle.addReading(POLICY, {1000, 4000, 1}, &reason);
+    link.joined = true;
+    link.sends = {false, false, false, false, false, false};
+    WakeCycle::Config config = CONFIG;
+    config.lightSleepMax = 0xffffffff;
+    TEST_ASSERT_EQUAL(WakeCycle::FAILED, cycle.send(config, link));
+    TEST_ASSERT_EQUAL_UINT8(1, cycle.readings().count());
+}
+
+void test_heartbeat_while_watching() {
+    FakeLink link;
+    SendPolicy::Reason reason;
+    startWake(false);
+    cycle.addReading(POLICY, {1000, 4000, 1}, &reason);
+    cycle.send(CONFIG, link);
+    uint16_t low, high;
+    TEST_ASSERT_TRUE(cycle.watchBand(50, 1010, &low, &high));
+    // Just inside of what SendPolicy sends
+    TEST_ASSERT_EQUAL_UINT16(951, low);
+    TEST_ASSERT_EQUAL_UINT16(1049, high);
+    TEST_ASSERT_EQUAL(SendPolicy::RANGE_CHANGED, SendPolicy::check(POLICY, cycle.shared(), high + 1, 4000, 1, 1));
+    TEST_ASSERT_EQUAL(SendPolicy::RANGE_CHANGED, SendPolicy::check(POLICY, cycle.shared(), low - 1, 4000, 1, 1));
+    TEST_ASSERT_TRUE(cycle.watchBand(50, 1200, &low, &high));
+    TEST_ASSERT_EQUAL_UINT16(1151, low);
+    WakeScheduler scheduler = {};
+    TEST_ASSERT_EQUAL_UINT64(CONFIG.heartbeatInterval * 1000ULL, cycle.sleepTime(CONFIG, scheduler, SCHEDULE, true));
+
+    // Woken by the sensor, not a heartbeat
+    startWake(false);
+    TEST_ASSERT_FALSE(cycle.heartbeatWake());
+    cycle.sleepTime(CONFIG, scheduler, SCHEDULE, true);
+    startWake(true);
+    TEST_ASSERT_TRUE(cycle.heartbeatWake());
+    TEST_ASSERT_TRUE(cycle.addReading(POLICY, {1001, 4000, 3}, &reason));
+    TEST_ASSERT_EQUAL(SendPolicy::HEARTBEAT, reason);
+}
+
+void test_nothing_shared_no_watch() {
+    uint16_t low, high;
+    TEST_ASSERT_FALSE(cycle.watchBand(50, 1000, &low, &high));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_reading_sent_fixed);
+    RUN_TEST(test_small_change_buffered);
+    RUN_TEST(test_baseline_from_last_reading_sent);
+    RUN_TEST(test_ack_in_front_and_kept_on_failure);
+    RUN_TEST(test_command_in_ack_downlink_stays_pending);
+    RUN_TEST(test_join_and_send_budgets_apart);
+    RUN_TEST(test_long_backoff_retried_in_own_wake);
+    RUN_TEST(test_gives_up);
+    RUN_TEST(test_heartbeat_while_watching);
+    RUN_TEST(test_nothing_shared_no_watch);
+    return UNITY_END();
+}
@@ -0,0 +1,62 @@
+#include "SEN0590Emulator.h"
+
+#include <Arduino.h>
+
+namespace {
+const uint8_t REG_RESULT = 0x02;
+const uint8_t REG_COMMAND = 0x10;
+const uint8_t CMD_MEASURE = 0xB0;
+}  // namespace
+
+SEN0590Emulator::SEN0590Emulator(uint32_t measureTimeUs, uint32_t selectTimeUs)
+    : measureTimeUs(measureTimeUs), selectTimeUs(selectTimeUs), distance(0), trace(NULL), traceLeft(0), result(0), reg(0), measureStart(0), selectStart(0), measuring(false), measurementCount(0) {
+}
+
+void SEN0590Emulator::setDistance(uint16_t distance) {
+    this->distance = distance;
+    traceLeft = 0;
+}
+
+void SEN0590Emulator::setTrace(const uint16_t *trace, size_t len) {
+    this->trace = trace;
+    traceLeft = len;
+}
+
+uint32_t SEN0590Emulator::measurements() const {
+    return measurementCount;
+}
+
+bool SEN0590Emulator::write(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        // Address probe
+        return true;
+    }
+    reg = data[0];
+    selectStart = micros();
+    if (reg == REG_COMMAND && len == 2 && data[1] == CMD_MEASURE) {
+        measureStart = micros();
+        measuring = true;
+        measurementCount++;
+        if (traceLeft > 0) {
+            distance = *trace++;
+            traceLeft--;
+        }
+    }
+    return true;
+}
+
+bool SEN0590Emulator::read(uint8_t *data, size_t len) {
+    if (measuring && micros() - measureStart >= measureTimeUs) {
+        result = distance > 10 ? distance - 10 : 0;
+        measuring = false;
+    }
+    bool selected = micros() - selectStart >= selectTimeUs;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t value = 0;
+        if (selected && !measuring && reg == REG_RESULT && i < 2) {
+            value = i == 0 ? result >> 8 : result & 0xff;
+        }
+        data[i] = value;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <I2CDevice.h>
+
+// Emulates the SEN0590 laser ranging sensor. Writing 0xB0 to register 0x10
+// starts a measurement, the result can be read from register 0x02 (2 bytes,
+// big-endian, distance minus 10 mm) once the measurement is done. Reads
+// that come too soon after the register was selected return zeroes.
+class SEN0590Emulator : public I2CDevice {
+   public:
+    static const uint8_t ADDRESS = 0x74;
+
+    SEN0590Emulator(uint32_t measureTimeUs = 40000, uint32_t selectTimeUs = 15000);
+
+    // Distance (mm) returned by the following measurements
+    void setDistance(uint16_t distance);
+    // Replays a recorded trace, one distance per measurement. 0 is a failed
+    // measurement. Once the trace runs out the last distance is kept.
+    void setTrace(const uint16_t *trace, size_t len);
+    uint32_t measurements() const;
+
+    bool write(const uint8_t *data, size_t len);
+    bool read(uint8_t *data, size_t len);
+
+   private:
+    uint32_t measureTimeUs;
+    uint32_t selectTimeUs;
+    uint16_t distance;
+    const uint16_t *trace;
+    size_t traceLeft;
+    uint16_t result;
+    uint8_t reg;
+    unsigned long measureStart;
+    unsigned long selectStart;
+    bool measuring;
+    uint32_t measurementCount;
+};
@@ -0,0 +1,121 @@
+#include "SSD1306Emulator.h"
+
+#include <string.h>
+
+namespace {
+const uint8_t CONTROL_DATA = 0x40;
+
+const uint8_t CMD_COLUMNADDR = 0x21;
+const uint8_t CMD_PAGEADDR = 0x22;
+const uint8_t CMD_DISPLAYOFF = 0xAE;
+const uint8_t CMD_DISPLAYON = 0xAF;
+
+// Number of argument bytes that follow a command
+uint8_t argumentCount(uint8_t cmd) {
+    switch (cmd) {
+        case CMD_COLUMNADDR:
+        case CMD_PAGEADDR:
+            return 2;
+        case 0x20:  // Memory addressing mode
+        case 0x81:  // Contrast
+        case 0x8D:  // Charge pump
+        case 0xA8:  // Multiplex ratio
+        case 0xD3:  // Display offset
+        case 0xD5:  // Clock divide
+        case 0xD9:  // Pre-charge period
+        case 0xDA:  // COM pins
+        case 0xDB:  // VCOMH deselect level
+            return 1;
+        case 0x26:  // Horizontal scroll setup
+        case 0x27:
+            return 6;
+        default:
+            return 0;
+    }
+}
+}  // namespace
+
+SSD1306Emulator::SSD1306Emulator()
+    : pendingCount(0), argsNeeded(0), colStart(0), colEnd(WIDTH - 1), pageStart(0), pageEnd(PAGES - 1), col(0), page(0), on(false), commandCount(0), dataCount(0) {
+    memset(buffer, 0, sizeof(buffer));
+}
+
+bool SSD1306Emulator::isOn() const {
+    return on;
+}
+
+const uint8_t *SSD1306Emulator::frame() const {
+    return buffer;
+}
+
+uint32_t SSD1306Emulator::commands() const {
+    return commandCount;
+}
+
+uint32_t SSD1306Emulator::dataBytes() const {
+    return dataCount;
+}
+
+bool SSD1306Emulator::write(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        // Address probe
+        return true;
+    }
+    bool isData = data[0] & CONTROL_DATA;
+    for (size_t i = 1; i < len; i++) {
+        if (isData) {
+            this->data(data[i]);
+        } else {
+            command(data[i]);
+        }
+    }
+    return true;
+}
+
+bool SSD1306Emulator::read(uint8_t *data, size_t len) {
+    // Status register: bit 6 is set while the display is off
+    memset(data, on ? 0x00 : 0x40, len);
+    return true;
+}
+
+void SSD1306Emulator::command(uint8_t cmd) {
+    if (argsNeeded > 0) {
+        if (pendingCount < sizeof(pending)) {
+            pending[pendingCount] = cmd;
+        }
+        pendingCount++;
+        if (--argsNeeded > 0) {
+            return;
+        }
+        if (pending[0] == CMD_COLUMNADDR) {
+            colStart = col = pending[1] % WIDTH;
+            colEnd = cmd % WIDTH;
+        } else if (pending[0] == CMD_PAGEADDR) {
+            pageStart = page = pending[1] % PAGES;
+            // Adafruit sends 0xFF as the end page, the controller only
+            // looks at the lower bits
+            pageEnd = cmd % PAGES;
+        }
+        return;
+    }
+    commandCount++;
+    if (cmd == CMD_DISPLAYON) {
+        on = true;
+    } else if (cmd == CMD_DISPLAYOFF) {
+        on = false;
+    }
+    argsNeeded = argumentCount(cmd);
+    pending[0] = cmd;
+    pendingCount = 1;
+}
+
+void SSD1306Emulator::data(uint8_t value) {
+    buffer[page * WIDTH + col] = value;
+    dataCount++;
+    if (col < colEnd) {
+        col++;
+        return;
+    }
+    col = colStart;
+    page = page < pageEnd ? page + 1 : pageStart;
+}
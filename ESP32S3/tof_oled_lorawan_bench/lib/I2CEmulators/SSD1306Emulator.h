@@ -0,0 +1,38 @@
+#pragma once
+
+#include <I2CDevice.h>
+
+// Emulates a 128x32 SSD1306 OLED controller. Every write starts with a
+// control byte, 0x00 for commands and 0x40 for display data. Display data
+// goes to the frame buffer at the address window set with the column and
+// page address commands (horizontal addressing mode).
+class SSD1306Emulator : public I2CDevice {
+   public:
+    static const uint8_t ADDRESS = 0x3C;
+    static const uint8_t WIDTH = 128;
+    static const uint8_t PAGES = 4;
+
+    SSD1306Emulator();
+
+    bool isOn() const;
+    const uint8_t *frame() const;
+    uint32_t commands() const;
+    uint32_t dataBytes() const;
+
+    bool write(const uint8_t *data, size_t len);
+    bool read(uint8_t *data, size_t len);
+
+   private:
+    void command(uint8_t cmd);
+    void data(uint8_t value);
+
+    uint8_t buffer[WIDTH * PAGES];
+    uint8_t pending[2];  // Command bytes waiting for their arguments
+    uint8_t pendingCount;
+    uint8_t argsNeeded;
+    uint8_t colStart, colEnd, pageStart, pageEnd;
+    uint8_t col, page;
+    bool on;
+    uint32_t commandCount;
+    uint32_t dataCount;
+};
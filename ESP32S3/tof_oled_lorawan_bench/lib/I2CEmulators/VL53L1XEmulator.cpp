@@ -0,0 +1,122 @@
+#include "VL53L1XEmulator.h"
+
+#include <Arduino.h>
+
+namespace {
+const uint32_t REG_COUNT = 0x10000;
+
+const uint16_t SOFT_RESET = 0x0000;
+const uint16_t OSC_MEASURED__FAST_OSC__FREQUENCY = 0x0006;
+const uint16_t GPIO__TIO_HV_STATUS = 0x0031;
+const uint16_t SYSTEM__INTERRUPT_CLEAR = 0x0086;
+const uint16_t SYSTEM__MODE_START = 0x0087;
+const uint16_t RESULT__RANGE_STATUS = 0x0089;
+const uint16_t RESULT__OSC_CALIBRATE_VAL = 0x00DE;
+const uint16_t FIRMWARE__SYSTEM_STATUS = 0x00E5;
+const uint16_t IDENTIFICATION__MODEL_ID = 0x010F;
+
+const uint8_t MODE_STOP = 0x80;
+const uint8_t MODE_SINGLE = 0x10;
+const uint8_t MODE_CONTINUOUS = 0x40;
+
+// Range status code for a valid measurement
+const uint8_t RANGE_COMPLETE = 9;
+// The data ready interrupt is active low
+const uint8_t DATA_READY = 0x00;
+const uint8_t NO_DATA = 0x01;
+
+void put16(uint8_t *regs, uint16_t reg, uint16_t value) {
+    regs[reg] = value >> 8;
+    regs[(uint16_t)(reg + 1)] = value & 0xff;
+}
+}  // namespace
+
+VL53L1XEmulator::VL53L1XEmulator(uint32_t measureTimeUs)
+    : regs(new uint8_t[REG_COUNT]), index(0), measureTimeUs(measureTimeUs), distance(0), measureStart(0), measuring(false), continuous(false), measurementCount(0) {
+    reset();
+}
+
+VL53L1XEmulator::~VL53L1XEmulator() {
+    delete[] regs;
+}
+
+void VL53L1XEmulator::setDistance(uint16_t distance) {
+    this->distance = distance;
+}
+
+void VL53L1XEmulator::setMeasureTime(uint32_t us) {
+    measureTimeUs = us;
+}
+
+uint32_t VL53L1XEmulator::measurements() const {
+    return measurementCount;
+}
+
+bool VL53L1XEmulator::write(const uint8_t *data, size_t len) {
+    if (len < 2) {
+        // Address probe, or a write without a complete register index
+        return true;
+    }
+    index = data[0] << 8 | data[1];
+    update();
+    for (size_t i = 2; i < len; i++, index++) {
+        regs[index] = data[i];
+        if (index == SOFT_RESET && data[i] == 0x00) {
+            reset();
+        } else if (index == SYSTEM__INTERRUPT_CLEAR && (data[i] & 0x01)) {
+            regs[GPIO__TIO_HV_STATUS] = NO_DATA;
+            if (continuous) {
+                measureStart = micros();
+                measuring = true;
+                measurementCount++;
+            }
+        } else if (index == SYSTEM__MODE_START) {
+            continuous = data[i] == MODE_CONTINUOUS;
+            measuring = data[i] == MODE_SINGLE || continuous;
+            if (measuring) {
+                measureStart = micros();
+                measurementCount++;
+            }
+        }
+    }
+    return true;
+}
+
+bool VL53L1XEmulator::read(uint8_t *data, size_t len) {
+    update();
+    for (size_t i = 0; i < len; i++, index++) {
+        data[i] = regs[index];
+    }
+    return true;
+}
+
+void VL53L1XEmulator::reset() {
+    memset(regs, 0, REG_COUNT);
+    put16(regs, IDENTIFICATION__MODEL_ID, 0xEACC);
+    put16(regs, OSC_MEASURED__FAST_OSC__FREQUENCY, 0xB4F3);
+    put16(regs, RESULT__OSC_CALIBRATE_VAL, 0x01E8);
+    regs[FIRMWARE__SYSTEM_STATUS] = 0x01;
+    regs[GPIO__TIO_HV_STATUS] = NO_DATA;
+    regs[SOFT_RESET] = 0x01;
+    measuring = false;
+    continuous = false;
+}
+
+void VL53L1XEmulator::update() {
+    if (!measuring || micros() - measureStart < measureTimeUs) {
+        return;
+    }
+    measuring = false;
+    // The driver scales the raw range by 2011 / 2048
+    uint16_t raw = ((uint32_t)distance * 0x800 + 1005) / 2011;
+    uint8_t *results = &regs[RESULT__RANGE_STATUS];
+    memset(results, 0, 17);
+    results[0] = RANGE_COMPLETE;
+    results[2] = measurementCount & 0xff ? measurementCount & 0xff : 1;  // Stream count
+    put16(regs, RESULT__RANGE_STATUS + 3, 0x0A00);  // Effective SPADs
+    put16(regs, RESULT__RANGE_STATUS + 5, 0x0800);  // Peak signal rate
+    put16(regs, RESULT__RANGE_STATUS + 7, 0x0040);  // Ambient rate
+    put16(regs, RESULT__RANGE_STATUS + 13, raw);
+    put16(regs, RESULT__RANGE_STATUS + 15, 0x0800);
+    regs[GPIO__TIO_HV_STATUS] = DATA_READY;
+}
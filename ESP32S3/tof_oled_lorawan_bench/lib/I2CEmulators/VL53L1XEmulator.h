@@ -0,0 +1,37 @@
+#pragma once
+
+#include <I2CDevice.h>
+
+// Emulates the VL53L1X time-of-flight sensor as far as the Pololu driver
+// needs it. Registers are plain memory with 16-bit auto-incrementing
+// addresses, apart from the ones that report the boot state, the data
+// ready flag and the ranging results.
+class VL53L1XEmulator : public I2CDevice {
+   public:
+    static const uint8_t ADDRESS = 0x29;
+
+    VL53L1XEmulator(uint32_t measureTimeUs = 80000);
+    ~VL53L1XEmulator();
+
+    // Distance (mm) returned by the following measurements
+    void setDistance(uint16_t distance);
+    // Time a measurement takes, follows the timing budget on a real sensor
+    void setMeasureTime(uint32_t us);
+    uint32_t measurements() const;
+
+    bool write(const uint8_t *data, size_t len);
+    bool read(uint8_t *data, size_t len);
+
+   private:
+    void reset();
+    void update();
+
+    uint8_t *regs;
+    uint16_t index;
+    uint32_t measureTimeUs;
+    uint16_t distance;
+    unsigned long measureStart;
+    bool measuring;
+    bool continuous;
+    uint32_t measurementCount;
+};
@@ -0,0 +1,57 @@
+#include "Adafruit_GFX.h"
+
+Adafruit_GFX::Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h), cursor_x(0), cursor_y(0), textsize(1), textcolor(0xFFFF) {
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    for (int16_t i = x; i < x + w; i++) {
+        for (int16_t j = y; j < y + h; j++) {
+            drawPixel(i, j, color);
+        }
+    }
+}
+
+void Adafruit_GFX::fillScreen(uint16_t color) {
+    fillRect(0, 0, WIDTH, HEIGHT, color);
+}
+
+void Adafruit_GFX::setCursor(int16_t x, int16_t y) {
+    cursor_x = x;
+    cursor_y = y;
+}
+
+void Adafruit_GFX::setTextSize(uint8_t size) {
+    textsize = size > 0 ? size : 1;
+}
+
+void Adafruit_GFX::setTextColor(uint16_t color) {
+    textcolor = color;
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+    if (c == '\n') {
+        cursor_x = 0;
+        cursor_y += textsize * 8;
+        return 1;
+    }
+    if (c == '\r') {
+        return 1;
+    }
+    // Wraps like the real library does by default
+    if (cursor_x + textsize * 6 > WIDTH) {
+        cursor_x = 0;
+        cursor_y += textsize * 8;
+    }
+    if (c != ' ') {
+        for (uint8_t col = 0; col < 5; col++) {
+            uint8_t bits = ((c * 37 + col * 11) ^ c) & 0x7F;
+            for (uint8_t row = 0; row < 7; row++) {
+                if (bits & (1 << row)) {
+                    fillRect(cursor_x + col * textsize, cursor_y + row * textsize, textsize, textsize, textcolor);
+                }
+            }
+        }
+    }
+    cursor_x += textsize * 6;
+    return 1;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Host version of the parts of Adafruit_GFX the firmware uses. Text is
+// drawn in the cells of the classic 6x8 font, scaled by the text size, but
+// the glyphs are made up from the character code. What matters on the bus
+// is which bytes of the frame change, not what they look like.
+class Adafruit_GFX : public Print {
+   public:
+    Adafruit_GFX(int16_t w, int16_t h);
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void fillScreen(uint16_t color);
+
+    void setCursor(int16_t x, int16_t y);
+    void setTextSize(uint8_t size);
+    void setTextColor(uint16_t color);
+    size_t write(uint8_t c);
+    using Print::write;
+
+    int16_t width() const { return WIDTH; }
+    int16_t height() const { return HEIGHT; }
+
+   protected:
+    const int16_t WIDTH;
+    const int16_t HEIGHT;
+    int16_t cursor_x;
+    int16_t cursor_y;
+    uint8_t textsize;
+    uint16_t textcolor;
+};
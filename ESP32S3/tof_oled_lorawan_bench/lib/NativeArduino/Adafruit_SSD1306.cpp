@@ -0,0 +1,138 @@
+#include "Adafruit_SSD1306.h"
+
+namespace {
+// Same limit the real library takes from the ESP32 core
+const size_t WIRE_MAX = min(256, I2C_BUFFER_LENGTH);
+}  // namespace
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi, int8_t rst_pin, uint32_t clkDuring, uint32_t clkAfter)
+    : Adafruit_GFX(w, h), wire(twi), buffer(NULL), i2caddr(0), vccstate(0), wireClk(clkDuring), restoreClk(clkAfter) {
+}
+
+Adafruit_SSD1306::~Adafruit_SSD1306() {
+    free(buffer);
+}
+
+bool Adafruit_SSD1306::begin(uint8_t vcs, uint8_t addr, bool reset, bool periphBegin) {
+    if (!buffer && !(buffer = (uint8_t *)malloc(WIDTH * ((HEIGHT + 7) / 8)))) {
+        return false;
+    }
+    clearDisplay();
+    vccstate = vcs;
+    i2caddr = addr ? addr : ((HEIGHT == 32) ? 0x3C : 0x3D);
+    if (periphBegin) {
+        wire->begin();
+    }
+
+    wire->setClock(wireClk);
+    static const uint8_t init1[] = {SSD1306_DISPLAYOFF, SSD1306_SETDISPLAYCLOCKDIV, 0x80, SSD1306_SETMULTIPLEX};
+    ssd1306_commandList(init1, sizeof(init1));
+    ssd1306_command1(HEIGHT - 1);
+
+    static const uint8_t init2[] = {SSD1306_SETDISPLAYOFFSET, 0x0, SSD1306_SETSTARTLINE | 0x0, SSD1306_CHARGEPUMP};
+    ssd1306_commandList(init2, sizeof(init2));
+    ssd1306_command1((vccstate == SSD1306_EXTERNALVCC) ? 0x10 : 0x14);
+
+    static const uint8_t init3[] = {SSD1306_MEMORYMODE, 0x00, SSD1306_SEGREMAP | 0x1, SSD1306_COMSCANDEC};
+    ssd1306_commandList(init3, sizeof(init3));
+
+    uint8_t comPins = 0x02;
+    uint8_t contrast = 0x8F;
+    if ((WIDTH == 128) && (HEIGHT == 64)) {
+        comPins = 0x12;
+        contrast = (vccstate == SSD1306_EXTERNALVCC) ? 0x9F : 0xCF;
+    } else if ((WIDTH == 96) && (HEIGHT == 16)) {
+        comPins = 0x2;
+        contrast = (vccstate == SSD1306_EXTERNALVCC) ? 0x10 : 0xAF;
+    }
+    ssd1306_command1(SSD1306_SETCOMPINS);
+    ssd1306_command1(comPins);
+    ssd1306_command1(SSD1306_SETCONTRAST);
+    ssd1306_command1(contrast);
+
+    ssd1306_command1(SSD1306_SETPRECHARGE);
+    ssd1306_command1((vccstate == SSD1306_EXTERNALVCC) ? 0x22 : 0xF1);
+    static const uint8_t init5[] = {SSD1306_SETVCOMDETECT, 0x40, SSD1306_DISPLAYALLON_RESUME, SSD1306_NORMALDISPLAY,
+                                    SSD1306_DEACTIVATE_SCROLL, SSD1306_DISPLAYON};
+    ssd1306_commandList(init5, sizeof(init5));
+    wire->setClock(restoreClk);
+    return true;
+}
+
+void Adafruit_SSD1306::display() {
+    wire->setClock(wireClk);
+    static const uint8_t dlist1[] = {SSD1306_PAGEADDR, 0, 0xFF, SSD1306_COLUMNADDR, 0};
+    ssd1306_commandList(dlist1, sizeof(dlist1));
+    ssd1306_command1(WIDTH - 1);
+
+    uint16_t count = WIDTH * ((HEIGHT + 7) / 8);
+    const uint8_t *ptr = buffer;
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x40);
+    size_t bytesOut = 1;
+    while (count--) {
+        if (bytesOut >= WIRE_MAX) {
+            wire->endTransmission();
+            wire->beginTransmission(i2caddr);
+            wire->write((uint8_t)0x40);
+            bytesOut = 1;
+        }
+        wire->write(*ptr++);
+        bytesOut++;
+    }
+    wire->endTransmission();
+    wire->setClock(restoreClk);
+}
+
+void Adafruit_SSD1306::clearDisplay() {
+    memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
+    if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) {
+        return;
+    }
+    uint8_t &b = buffer[x + (y / 8) * WIDTH];
+    uint8_t bit = 1 << (y & 7);
+    if (color == WHITE) {
+        b |= bit;
+    } else if (color == BLACK) {
+        b &= ~bit;
+    } else if (color == INVERSE) {
+        b ^= bit;
+    }
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c) {
+    wire->setClock(wireClk);
+    ssd1306_command1(c);
+    wire->setClock(restoreClk);
+}
+
+uint8_t *Adafruit_SSD1306::getBuffer() {
+    return buffer;
+}
+
+void Adafruit_SSD1306::ssd1306_command1(uint8_t c) {
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00);
+    wire->write(c);
+    wire->endTransmission();
+}
+
+void Adafruit_SSD1306::ssd1306_commandList(const uint8_t *c, uint8_t n) {
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00);
+    size_t bytesOut = 1;
+    while (n--) {
+        if (bytesOut >= WIRE_MAX) {
+            wire->endTransmission();
+            wire->beginTransmission(i2caddr);
+            wire->write((uint8_t)0x00);
+            bytesOut = 1;
+        }
+        wire->write(*c++);
+        bytesOut++;
+    }
+    wire->endTransmission();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// Just enough of the Arduino API to build the drivers of tof_oled_lorawan
+// for the host. Time is simulated: it only moves forward on delay() and
+// while the I2C bus is busy, so runs are fast and always give the same
+// results.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+// Pins of the Seeed XIAO ESP32S3
+static const uint8_t D7 = 44;
+static const uint8_t A0 = 1;
+static const uint8_t LED_BUILTIN = 21;
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// Moves the simulated clock forward
+void advanceMicros(uint64_t us);
+
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size);
+
+    size_t print(const char *s);
+    size_t print(const __FlashStringHelper *s);
+    size_t print(char c);
+    size_t print(int n);
+    size_t print(unsigned int n);
+    size_t print(long n);
+    size_t print(unsigned long n);
+    size_t print(double n, int digits = 2);
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    template <typename T>
+    size_t println(T value) {
+        size_t n = print(value);
+        return n + println();
+    }
+    size_t println();
+};
+
+class HardwareSerial : public Print {
+   public:
+    void begin(unsigned long baud) {}
+    void end() {}
+    void flush() {}
+    size_t write(uint8_t c);
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
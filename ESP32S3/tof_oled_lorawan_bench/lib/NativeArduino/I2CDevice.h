@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// An emulated device on the native I2C bus
+class I2CDevice {
+   public:
+    virtual ~I2CDevice() {}
+    // Handles a write transaction, returns false to NACK it
+    virtual bool write(const uint8_t *data, size_t len) = 0;
+    // Handles a read transaction, returns false to NACK it
+    virtual bool read(uint8_t *data, size_t len) = 0;
+};
@@ -0,0 +1,253 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <stdarg.h>
+
+namespace {
+uint64_t now;
+}
+
+void advanceMicros(uint64_t us) {
+    now += us;
+}
+
+unsigned long millis() {
+    return now / 1000;
+}
+
+unsigned long micros() {
+    return now;
+}
+
+void delay(unsigned long ms) {
+    advanceMicros(ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+    advanceMicros(us);
+}
+
+void yield() {
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+}
+
+int digitalRead(uint8_t pin) {
+    return LOW;
+}
+
+size_t Print::write(const uint8_t *buf, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*buf++);
+    }
+    return n;
+}
+
+size_t Print::print(const char *s) {
+    return write((const uint8_t *)s, strlen(s));
+}
+
+size_t Print::print(const __FlashStringHelper *s) {
+    return print(reinterpret_cast<const char *>(s));
+}
+
+size_t Print::print(char c) {
+    return write(c);
+}
+
+size_t Print::print(int n) {
+    return printf("%d", n);
+}
+
+size_t Print::print(unsigned int n) {
+    return printf("%u", n);
+}
+
+size_t Print::print(long n) {
+    return printf("%ld", n);
+}
+
+size_t Print::print(unsigned long n) {
+    return printf("%lu", n);
+}
+
+size_t Print::print(double n, int digits) {
+    return printf("%.*f", digits, n);
+}
+
+size_t Print::printf(const char *format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    return write((const uint8_t *)buf, min((size_t)len, sizeof(buf) - 1));
+}
+
+size_t Print::println() {
+    return print("\r\n");
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (c != '\r') {
+        putchar(c);
+    }
+    return 1;
+}
+
+HardwareSerial Serial;
+
+TwoWire::TwoWire() : frequency(100000), slotCount(0), unknown(), txAddress(0), txLength(0), rxLength(0), rxIndex(0) {
+}
+
+bool TwoWire::begin() {
+    return true;
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    if (frequency) {
+        setClock(frequency);
+    }
+    return true;
+}
+
+void TwoWire::setClock(uint32_t frequency) {
+    this->frequency = frequency;
+}
+
+uint32_t TwoWire::getClock() const {
+    return frequency;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    txAddress = address;
+    txLength = 0;
+}
+
+void TwoWire::beginTransmission(int address) {
+    beginTransmission((uint8_t)address);
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if (txLength >= BUFFER_LENGTH) {
+        return 0;
+    }
+    txBuffer[txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity) {
+    size_t n = 0;
+    while (n < quantity && write(data[n])) {
+        n++;
+    }
+    return n;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    Slot *slot = find(txAddress);
+    bool acked = slot != NULL && slot->device->write(txBuffer, txLength);
+    account(slot, txAddress, txLength, acked);
+    txLength = 0;
+    // Same error codes as the Arduino core: 2 is a NACK on the address
+    return acked ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop) {
+    rxIndex = 0;
+    rxLength = 0;
+    size_t len = quantity < BUFFER_LENGTH ? quantity : BUFFER_LENGTH;
+    Slot *slot = find(address);
+    bool acked = slot != NULL && slot->device->read(rxBuffer, len);
+    account(slot, address, acked ? len : 0, acked);
+    if (acked) {
+        rxLength = len;
+    }
+    return rxLength;
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity, int sendStop) {
+    return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t)sendStop);
+}
+
+int TwoWire::available() {
+    return rxLength - rxIndex;
+}
+
+int TwoWire::read() {
+    return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+}
+
+int TwoWire::peek() {
+    return rxIndex < rxLength ? rxBuffer[rxIndex] : -1;
+}
+
+bool TwoWire::attach(uint8_t address, I2CDevice &device) {
+    if (slotCount == MAX_DEVICES || find(address) != NULL) {
+        return false;
+    }
+    slots[slotCount++] = {address, &device, {}};
+    return true;
+}
+
+const TwoWire::Stats &TwoWire::stats(uint8_t address) const {
+    for (uint8_t i = 0; i < slotCount; i++) {
+        if (slots[i].address == address) {
+            return slots[i].stats;
+        }
+    }
+    return unknown;
+}
+
+TwoWire::Stats TwoWire::total() const {
+    Stats total = unknown;
+    for (uint8_t i = 0; i < slotCount; i++) {
+        total.transactions += slots[i].stats.transactions;
+        total.bytes += slots[i].stats.bytes;
+        total.bits += slots[i].stats.bits;
+        total.nacks += slots[i].stats.nacks;
+    }
+    return total;
+}
+
+void TwoWire::resetStats() {
+    for (uint8_t i = 0; i < slotCount; i++) {
+        slots[i].stats = {};
+    }
+    unknown = {};
+}
+
+uint64_t TwoWire::busTimeUs(uint64_t bits, uint32_t frequency) {
+    return (bits * 1000000ULL + frequency - 1) / frequency;
+}
+
+TwoWire::Slot *TwoWire::find(uint8_t address) {
+    for (uint8_t i = 0; i < slotCount; i++) {
+        if (slots[i].address == address) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+void TwoWire::account(Slot *slot, uint8_t address, size_t len, bool acked) {
+    Stats &stats = slot != NULL ? slot->stats : unknown;
+    // Start, address and R/W with ACK, 9 bits for every data byte, stop
+    uint32_t bits = 1 + 9 + 9 * len + 1;
+    stats.transactions++;
+    stats.bytes += len;
+    stats.bits += bits;
+    if (!acked) {
+        stats.nacks++;
+    }
+    advanceMicros(busTimeUs(bits, frequency));
+}
+
+TwoWire Wire;
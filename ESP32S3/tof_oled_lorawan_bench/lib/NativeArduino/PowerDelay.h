@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Host version of the PowerDelay library, waits just move the simulated
+// clock forward
+namespace PowerDelay {
+
+const uint32_t MIN_SLEEP_US = 1000;
+const uint32_t LIGHT_SLEEP_MIN_MS = 20;
+
+inline bool begin(const uint8_t *keepPins, uint8_t count) {
+    return false;
+}
+
+inline bool lightSleepEnabled() {
+    return false;
+}
+
+inline void hold() {
+}
+
+inline void release() {
+}
+
+inline void sleepHeld(uint32_t ms) {
+    delay(ms);
+}
+
+}  // namespace PowerDelay
+
+inline void sleepFor(uint32_t ms) {
+    delay(ms);
+}
+
+inline void sleepForUs(uint32_t us) {
+    delayMicroseconds(us);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <I2CDevice.h>
+
+// Same as the ESP32 core, the display drivers split their writes on it
+#define I2C_BUFFER_LENGTH 128
+
+// Host replacement for the Arduino Wire library. Transactions go to the
+// emulated devices attached to the bus and are counted per address. Every
+// transaction moves the simulated clock forward by the time it takes on
+// the bus at the current clock speed.
+class TwoWire {
+   public:
+    static const size_t BUFFER_LENGTH = I2C_BUFFER_LENGTH;
+    static const uint8_t MAX_DEVICES = 8;
+
+    struct Stats {
+        uint32_t transactions;
+        uint32_t bytes;  // Data bytes, not counting the address
+        uint32_t bits;   // Everything on the bus, including start and stop
+        uint32_t nacks;
+    };
+
+    TwoWire();
+
+    bool begin();
+    bool begin(int sda, int scl, uint32_t frequency = 0);
+    void end() {}
+    void setClock(uint32_t frequency);
+    uint32_t getClock() const;
+
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t quantity);
+    uint8_t endTransmission(bool sendStop = true);
+
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop = 1);
+    uint8_t requestFrom(int address, int quantity, int sendStop = 1);
+    int available();
+    int read();
+    int peek();
+
+    // Emulation support
+    bool attach(uint8_t address, I2CDevice &device);
+    const Stats &stats(uint8_t address) const;
+    Stats total() const;
+    void resetStats();
+    // Time `bits` take on the bus at `frequency`
+    static uint64_t busTimeUs(uint64_t bits, uint32_t frequency);
+
+   private:
+    struct Slot {
+        uint8_t address;
+        I2CDevice *device;
+        Stats stats;
+    };
+
+    Slot *find(uint8_t address);
+    void account(Slot *slot, uint8_t address, size_t len, bool acked);
+
+    uint32_t frequency;
+    Slot slots[MAX_DEVICES];
+    uint8_t slotCount;
+    Stats unknown;  // Transactions to addresses without a device
+
+    uint8_t txAddress;
+    uint8_t txBuffer[BUFFER_LENGTH];
+    size_t txLength;
+    uint8_t rxBuffer[BUFFER_LENGTH];
+    size_t rxLength;
+    size_t rxIndex;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,301 @@
+/*
+ * Runs the I2C drivers of tof_oled_lorawan against emulated devices on the
+ * host and reports the bus traffic of a single wake: transactions, bytes
+ * and the time they take on the bus at 100 kHz and 400 kHz. It exits with
+ * an error if a driver doesn't get the emulated range back.
+ *
+ * It then replays a synthetic SEN0590 trace (noise, outliers and failed
+ * measurements on a drifting level) through single reads and RangeFilter
+ * bursts, and reports how often each would send an uplink the level
+ * didn't call for.
+ *
+ * The SSD1306 part runs PartialSSD1306 on top of the host version of
+ * Adafruit_SSD1306 in lib/NativeArduino, which sends the same traffic as
+ * the real library.
+ */
+
+#include <Arduino.h>
+#include <I2CBus.h>
+#include <PartialSSD1306.h>
+#include <RangeFilter.h>
+#include <SEN0590Emulator.h>
+#include <SEN0590_DSensor.h>
+#include <SSD1306Emulator.h>
+#include <VL53L1XEmulator.h>
+#include <VL53L1X_DSensor.h>
+#include <Wire.h>
+#include <math.h>
+
+namespace {
+
+const uint16_t DISTANCE_MM = 1234;
+const uint8_t BURST_LENGTH = 5;  // Same as RANGE_BURST_LENGTH
+const uint32_t CLOCKS[] = {100000, 400000};
+
+// False trigger trace
+const uint32_t TRACE_WAKES = 5000;
+const uint16_t SIGNIFICANT_DELTA = 50;  // Same as RANGE_SIGNIFICANT_DELTA
+const uint8_t MAX_BURST = 7;
+const float NOISE_MM = 5.0f;            // Standard deviation of a good reading
+const uint16_t OUTLIER_PERMILLE = 30;   // Spray, reflections off the walls
+const uint16_t DROPOUT_PERMILLE = 10;   // Failed measurements
+const uint16_t STEP_PERMILLE = 5;       // Wakes with a real level change
+
+struct Result {
+    const char *name;
+    uint8_t address;
+    TwoWire::Stats stats;
+    unsigned long elapsedMs;
+    bool ok;
+};
+
+struct TraceWake {
+    uint16_t level;  // True level
+    uint16_t samples[MAX_BURST];
+};
+
+struct TraceResult {
+    const char *name;
+    uint32_t triggers;
+    uint32_t falseTriggers;
+    uint32_t missed;
+    uint32_t invalid;
+    unsigned long awakeMs;
+};
+
+TraceWake trace[TRACE_WAKES];
+uint32_t rngState = 0x12345678;
+
+uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+float nextGaussian() {
+    // Box-Muller
+    float u1 = (nextRandom() % 1000000 + 1) / 1000001.0f;
+    float u2 = (nextRandom() % 1000000) / 1000000.0f;
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+uint16_t deviation(uint16_t a, uint16_t b) {
+    return a > b ? a - b : b - a;
+}
+
+void makeTrace() {
+    int32_t level = 1500;
+    for (TraceWake &wake : trace) {
+        level += (int32_t)(nextRandom() % 3) - 1;
+        if (nextRandom() % 1000 < STEP_PERMILLE) {
+            int32_t step = 60 + nextRandom() % 540;
+            level += nextRandom() % 2 ? step : -step;
+        }
+        level = level < 300 ? 300 : level > 3500 ? 3500 : level;
+        wake.level = level;
+        for (uint16_t &sample : wake.samples) {
+            uint32_t r = nextRandom() % 1000;
+            if (r < DROPOUT_PERMILLE) {
+                sample = 0;
+            } else if (r < DROPOUT_PERMILLE + OUTLIER_PERMILLE) {
+                sample = 50 + nextRandom() % 3950;
+            } else {
+                sample = lroundf(level + NOISE_MM * nextGaussian());
+            }
+        }
+    }
+}
+
+// Decides on an uplink the way SendPolicy does for the range. A trigger is
+// false if the true level moved less than the delta since the last uplink,
+// a change is missed while it moved by twice the delta and nothing was sent.
+TraceResult runTrace(const char *name, IDistanceSensor &sensor, SEN0590Emulator &emulator) {
+    TraceResult result = {name, 0, 0, 0, 0, 0};
+    uint16_t lastSent = IDistanceSensor::INVALID_RANGE;
+    uint16_t lastSentLevel = 0;
+    for (const TraceWake &wake : trace) {
+        emulator.setTrace(wake.samples, MAX_BURST);
+        unsigned long start = millis();
+        uint16_t range = sensor.read();
+        result.awakeMs += millis() - start;
+        if (range == IDistanceSensor::INVALID_RANGE) {
+            result.invalid++;
+            continue;
+        }
+        uint16_t moved = deviation(wake.level, lastSentLevel);
+        if (lastSent == IDistanceSensor::INVALID_RANGE || deviation(range, lastSent) >= SIGNIFICANT_DELTA) {
+            if (lastSent != IDistanceSensor::INVALID_RANGE) {
+                result.triggers++;
+                result.falseTriggers += moved < SIGNIFICANT_DELTA;
+            }
+            lastSent = range;
+            lastSentLevel = wake.level;
+        } else if (moved >= 2 * SIGNIFICANT_DELTA) {
+            result.missed++;
+        }
+    }
+    return result;
+}
+
+void printTraceResult(const TraceResult &result) {
+    Serial.printf("%-9s %8u %6u %12.1f %7u %8u %8.0f\n", result.name, result.triggers, result.falseTriggers,
+                  result.falseTriggers * 1000.0f / TRACE_WAKES, result.missed, result.invalid, (float)result.awakeMs / TRACE_WAKES);
+}
+
+bool runTraces(SEN0590Emulator &emulator) {
+    I2CBus bus;
+    bus.add(SEN0590::ADDRESS, CLOCKS[1], "SEN0590");
+    bus.begin();
+    SEN0590_DSensor sen0590(bus);
+    RangeFilter<3> burst3(sen0590);
+    RangeFilter<BURST_LENGTH> burst5(sen0590);
+    RangeFilter<MAX_BURST> burst7(sen0590);
+    makeTrace();
+    uint32_t realChanges = 0;
+    for (uint32_t i = 1; i < TRACE_WAKES; i++) {
+        realChanges += deviation(trace[i].level, trace[i - 1].level) >= SIGNIFICANT_DELTA;
+    }
+    TraceResult results[] = {
+        runTrace("single", sen0590, emulator),
+        runTrace("burst 3", burst3, emulator),
+        runTrace("burst 5", burst5, emulator),
+        runTrace("burst 7", burst7, emulator),
+    };
+
+    Serial.printf("\nSEN0590 trace, %u wakes, %u level steps, %u mm delta\n", TRACE_WAKES, realChanges, SIGNIFICANT_DELTA);
+    Serial.println(F("Reading   Triggers  False  False/1000w  Missed  Invalid  ms/wake"));
+    for (const TraceResult &result : results) {
+        printTraceResult(result);
+    }
+    // The burst the firmware uses has to do better than a single read
+    if (results[2].falseTriggers >= results[0].falseTriggers) {
+        Serial.println(F("ERR: RangeFilter doesn't reduce the false triggers"));
+        return false;
+    }
+    return true;
+}
+
+bool runRange(IDistanceSensor &sensor, uint16_t expected) {
+    RangeFilter<BURST_LENGTH> filter(sensor);
+    if (!filter.init()) {
+        Serial.println(F("ERR: Sensor init failed"));
+        return false;
+    }
+    uint16_t range = filter.read();
+    filter.disable();
+    if (range != expected) {
+        Serial.printf("ERR: Expected range %u, got %u\n", expected, range);
+        return false;
+    }
+    return true;
+}
+
+bool runDisplay(I2CBus &bus, uint32_t clock, const SSD1306Emulator &emulator) {
+    // Same calls as initDisplay(), showAppInfo(), showRange() and
+    // showSubtext() on a button wake. The driver keeps the bus clock of
+    // the round.
+    I2CBus::Lock lock(bus, SSD1306Emulator::ADDRESS);
+    PartialSSD1306 display(SSD1306Emulator::WIDTH, SSD1306Emulator::PAGES * 8, &Wire, clock, clock);
+    if (!display.begin(SSD1306_SWITCHCAPVCC, SSD1306Emulator::ADDRESS)) {
+        Serial.println(F("ERR: Display init failed"));
+        return false;
+    }
+    display.ssd1306_command(SSD1306_DISPLAYON);
+    display.display();
+    display.setTextSize(2);
+    display.clearDisplay();
+    display.display();
+
+    display.setTextColor(WHITE);
+    display.setTextSize(1);
+    display.clearDisplay();
+    display.setCursor(0, 0);
+    display.println(F("Depth Sensor v0.5"));
+    display.print(F("Last depth(mm): "));
+    display.println(DISTANCE_MM);
+    display.print(F("Boot count: "));
+    display.println(42);
+    display.print(F("Battery(mV):"));
+    display.println(3987);
+    display.update();
+
+    display.setTextSize(2);
+    display.clearDisplay();
+    display.setCursor(0, 0);
+    display.print((int)round(DISTANCE_MM / 10.0));
+    display.print("cm");
+    display.update();
+
+    display.fillRect(0, display.height() - 8, display.width(), 8, BLACK);
+    display.setTextSize(1);
+    display.setCursor(0, display.height() - 8);
+    display.print(F("send ok"));
+    display.update();
+
+    display.ssd1306_command(SSD1306_DISPLAYOFF);
+    if (emulator.isOn() || memcmp(emulator.frame(), display.getBuffer(), SSD1306Emulator::WIDTH * SSD1306Emulator::PAGES) != 0) {
+        Serial.println(F("ERR: Display frame mismatch"));
+        return false;
+    }
+    return true;
+}
+
+void printResult(const Result &result) {
+    const TwoWire::Stats &s = result.stats;
+    Serial.printf("%-8s 0x%02X %6u %7u %5u %10lu %10lu %8lu %s\n", result.name, result.address, s.transactions, s.bytes, s.nacks,
+                  (unsigned long)TwoWire::busTimeUs(s.bits, CLOCKS[0]), (unsigned long)TwoWire::busTimeUs(s.bits, CLOCKS[1]),
+                  result.elapsedMs, result.ok ? "ok" : "FAIL");
+}
+
+}  // namespace
+
+int main() {
+    SEN0590Emulator sen0590Emulator;
+    VL53L1XEmulator vl53l1xEmulator;
+    SSD1306Emulator ssd1306Emulator;
+    sen0590Emulator.setDistance(DISTANCE_MM);
+    vl53l1xEmulator.setDistance(DISTANCE_MM);
+    Wire.attach(SEN0590Emulator::ADDRESS, sen0590Emulator);
+    Wire.attach(VL53L1XEmulator::ADDRESS, vl53l1xEmulator);
+    Wire.attach(SSD1306Emulator::ADDRESS, ssd1306Emulator);
+
+    bool ok = true;
+    for (uint32_t clock : CLOCKS) {
+        // All devices at the same clock so the rounds can be compared
+        I2CBus bus;
+        bus.add(SSD1306Emulator::ADDRESS, clock, "SSD1306");
+        bus.add(SEN0590::ADDRESS, clock, "SEN0590");
+        bus.add(VL53L1X_DSensor::ADDRESS, clock, "VL53L1X");
+        bus.begin();
+        SEN0590_DSensor sen0590(bus);
+        VL53L1X_DSensor vl53l1x(bus);
+        Result results[3] = {
+            {"SEN0590", SEN0590Emulator::ADDRESS, {}, 0, false},
+            {"VL53L1X", VL53L1XEmulator::ADDRESS, {}, 0, false},
+            {"SSD1306", SSD1306Emulator::ADDRESS, {}, 0, false},
+        };
+        for (Result &result : results) {
+            Wire.resetStats();
+            unsigned long start = millis();
+            if (result.address == SEN0590Emulator::ADDRESS) {
+                result.ok = runRange(sen0590, DISTANCE_MM);
+            } else if (result.address == VL53L1XEmulator::ADDRESS) {
+                result.ok = runRange(vl53l1x, DISTANCE_MM);
+            } else {
+                result.ok = runDisplay(bus, clock, ssd1306Emulator);
+            }
+            result.elapsedMs = millis() - start;
+            result.stats = Wire.stats(result.address);
+            ok = ok && result.ok;
+        }
+
+        Serial.printf("\nBus clock %lu kHz\n", (unsigned long)clock / 1000);
+        Serial.println(F("Device   Addr  Trans   Bytes NACKs  us@100kHz  us@400kHz  wake ms"));
+        for (const Result &result : results) {
+            printResult(result);
+        }
+    }
+    ok = runTraces(sen0590Emulator) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <RemoteConfig.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Command line handling of the encoder, apart from main() so the tests
+// can run it
+
+struct Option {
+    const char *name;
+    RemoteConfig::Param param;
+    const char *help;
+};
+
+extern const Option options[];
+extern const size_t OPTION_COUNT;
+
+// Encodes the command given by --seq=<n> and --<setting>=<value>
+// arguments, and checks it the way the firmware will. Returns the command
+// length, or 0 with `error` set to the reason.
+size_t parseCommand(int argc, const char *const *argv, uint8_t *buf, size_t maxLen, const char **error);
+
+// Decodes the acknowledgement at the start of a hex uplink payload
+bool parseAck(const char *hex, uint8_t *seq, RemoteConfig::Status *status);
@@ -0,0 +1,125 @@
+#include "commands.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const Option options[] = {
+    {"min-interval", RemoteConfig::MIN_INTERVAL, "Seconds between wakes while the level changes"},
+    {"max-interval", RemoteConfig::MAX_INTERVAL, "Seconds between wakes while the level is stable"},
+    {"range-delta", RemoteConfig::RANGE_DELTA, "Range change (mm) worth sending"},
+    {"voltage-delta", RemoteConfig::VOLTAGE_DELTA, "Voltage change (mV) worth sending"},
+    {"boot-delta", RemoteConfig::BOOT_DELTA, "Number of wakes after which the sensor sends anyway"},
+};
+const size_t OPTION_COUNT = sizeof(options) / sizeof(options[0]);
+
+namespace {
+
+bool parseNumber(const char *text, uint32_t max, uint32_t *value) {
+    char *end;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (*text < '0' || *text > '9' || *end != 0 || parsed > max) {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+}  // namespace
+
+size_t parseCommand(int argc, const char *const *argv, uint8_t *buf, size_t maxLen, const char **error) {
+    uint32_t seq = 0;
+    RemoteConfig::Param params[OPTION_COUNT];
+    uint32_t values[OPTION_COUNT];
+    uint8_t count = 0;
+    for (int i = 0; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *eq = strchr(arg, '=');
+        if (strncmp(arg, "--", 2) != 0 || eq == NULL) {
+            *error = "Unknown argument";
+            return 0;
+        }
+        size_t nameLen = eq - arg - 2;
+        if (nameLen == 3 && strncmp(arg + 2, "seq", 3) == 0) {
+            if (!parseNumber(eq + 1, 255, &seq) || seq == 0) {
+                *error = "The sequence number must be 1 to 255";
+                return 0;
+            }
+            continue;
+        }
+        const Option *option = NULL;
+        for (size_t j = 0; j < OPTION_COUNT; j++) {
+            if (strlen(options[j].name) == nameLen && strncmp(options[j].name, arg + 2, nameLen) == 0) {
+                option = &options[j];
+            }
+        }
+        if (option == NULL) {
+            *error = "Unknown setting";
+            return 0;
+        }
+        for (uint8_t j = 0; j < count; j++) {
+            if (params[j] == option->param) {
+                *error = "Setting given twice";
+                return 0;
+            }
+        }
+        if (!parseNumber(eq + 1, UINT32_MAX, &values[count])) {
+            *error = "Values must be decimal numbers";
+            return 0;
+        }
+        params[count++] = option->param;
+    }
+    if (seq == 0) {
+        *error = "A --seq is needed, a new one for every command";
+        return 0;
+    }
+    if (count == 0) {
+        *error = "Nothing to set";
+        return 0;
+    }
+
+    size_t len = RemoteConfig::encodeCommand(seq, params, values, count, buf, maxLen);
+    if (len == 0) {
+        *error = "Value too large for its setting";
+        return 0;
+    }
+    // Check it against the limits of the firmware. The device also checks
+    // the values it doesn't get against the new ones, so this can't catch
+    // everything.
+    RemoteConfig::Settings settings = {RemoteConfig::INTERVAL_MIN, RemoteConfig::INTERVAL_MAX, 1, 1, 1};
+    uint8_t checked;
+    RemoteConfig::Status status = RemoteConfig::apply(buf, len, settings, 0, &checked);
+    if (status != RemoteConfig::OK) {
+        *error = RemoteConfig::describe(status);
+        return 0;
+    }
+    return len;
+}
+
+bool parseAck(const char *hex, uint8_t *seq, RemoteConfig::Status *status) {
+    uint8_t buf[RemoteConfig::ACK_SIZE];
+    for (size_t i = 0; i < RemoteConfig::ACK_SIZE; i++) {
+        int high = hexDigit(hex[0]);
+        int low = high < 0 ? -1 : hexDigit(hex[1]);
+        if (low < 0) {
+            return false;
+        }
+        buf[i] = (high << 4) | low;
+        hex += 2;
+    }
+    *seq = buf[0];
+    *status = (RemoteConfig::Status)buf[1];
+    return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * Encodes the downlink commands that change the sampling and reporting
+ * policy of tof_oled_lorawan, and decodes the acknowledgements it sends
+ * back. Uses the same RemoteConfig code as the firmware.
+ *
+ * The command is printed in hex, to be scheduled on RemoteConfig::PORT
+ * with the network server. Every new command needs a new --seq, the
+ * sensor only acknowledges a repeat of the last one it applied. See --help.
+ */
+
+#ifndef PIO_UNIT_TESTING
+
+#include <stdio.h>
+#include <string.h>
+
+#include "commands.h"
+
+namespace {
+
+void usage() {
+    printf("Usage: program --seq=<1-255> --<setting>=<value>...\n");
+    printf("       program --ack=<hex uplink>\n\nSettings:\n");
+    for (size_t i = 0; i < OPTION_COUNT; i++) {
+        printf("  --%-14s %s\n", options[i].name, options[i].help);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "--help") == 0) {
+        usage();
+        return 0;
+    }
+    if (argc == 2 && strncmp(argv[1], "--ack=", 6) == 0) {
+        uint8_t seq;
+        RemoteConfig::Status status;
+        if (!parseAck(argv[1] + 6, &seq, &status)) {
+            fprintf(stderr, "Acknowledgement too short or not hex\n");
+            return 2;
+        }
+        printf("seq %u: %s\n", seq, RemoteConfig::describe(status));
+        return status == RemoteConfig::OK || status == RemoteConfig::DUPLICATE ? 0 : 1;
+    }
+
+    uint8_t command[RemoteConfig::MAX_COMMAND_SIZE];
+    const char *error;
+    size_t len = parseCommand(argc - 1, argv + 1, command, sizeof(command), &error);
+    if (len == 0) {
+        fprintf(stderr, "%s\n", error);
+        usage();
+        return 2;
+    }
+    for (size_t i = 0; i < len; i++) {
+        printf("%02X", command[i]);
+    }
+    printf("\n");
+    return 0;
+}
+
+#endif
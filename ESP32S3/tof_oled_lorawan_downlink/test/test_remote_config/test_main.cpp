@@ -0,0 +1,266 @@
+// Host tests of RemoteConfig and of the encoder, run with: pio test
+
+#include <RemoteConfig.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "commands.h"
+
+namespace {
+
+const RemoteConfig::Settings DEFAULTS = {300, 3600, 20, 50, 24};
+
+RemoteConfig::Settings settings;
+
+RemoteConfig::Status applyCommand(const uint8_t *buf, size_t len, uint8_t lastSeq = 0) {
+    uint8_t seq;
+    return RemoteConfig::apply(buf, len, settings, lastSeq, &seq);
+}
+
+// Encodes and applies a command setting a single parameter
+RemoteConfig::Status applyOne(RemoteConfig::Param param, uint32_t value) {
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    size_t len = RemoteConfig::encodeCommand(1, &param, &value, 1, buf, sizeof(buf));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    return applyCommand(buf, len);
+}
+
+bool unchanged() {
+    return memcmp(&settings, &DEFAULTS, sizeof(settings)) == 0;
+}
+
+}  // namespace
+
+void setUp() {
+    settings = DEFAULTS;
+}
+
+void tearDown() {
+}
+
+void test_command_layout() {
+    const RemoteConfig::Param params[] = {RemoteConfig::MAX_INTERVAL, RemoteConfig::RANGE_DELTA};
+    const uint32_t values[] = {0x00012345, 0x0102};
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    size_t len = RemoteConfig::encodeCommand(9, params, values, 2, buf, sizeof(buf));
+    const uint8_t expected[] = {9, 2, 0x00, 0x01, 0x23, 0x45, 3, 0x01, 0x02};
+    TEST_ASSERT_EQUAL(sizeof(expected), len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, len);
+}
+
+void test_each_setting() {
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::MIN_INTERVAL, 120));
+    TEST_ASSERT_EQUAL_UINT32(120, settings.minInterval);
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::MAX_INTERVAL, 7200));
+    TEST_ASSERT_EQUAL_UINT32(7200, settings.maxInterval);
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::RANGE_DELTA, 35));
+    TEST_ASSERT_EQUAL_UINT16(35, settings.rangeDelta);
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::VOLTAGE_DELTA, 80));
+    TEST_ASSERT_EQUAL_UINT16(80, settings.voltageDelta);
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::BOOT_DELTA, 100));
+    TEST_ASSERT_EQUAL_UINT16(100, settings.bootDelta);
+}
+
+void test_bounds() {
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::MIN_INTERVAL, RemoteConfig::INTERVAL_MIN));
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::MAX_INTERVAL, RemoteConfig::INTERVAL_MAX));
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::RANGE_DELTA, RemoteConfig::RANGE_DELTA_MAX));
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::VOLTAGE_DELTA, RemoteConfig::VOLTAGE_DELTA_MAX));
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyOne(RemoteConfig::BOOT_DELTA, 0xFFFF));
+
+    setUp();
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::MIN_INTERVAL, RemoteConfig::INTERVAL_MIN - 1));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::MAX_INTERVAL, RemoteConfig::INTERVAL_MAX + 1));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::RANGE_DELTA, 0));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::RANGE_DELTA, RemoteConfig::RANGE_DELTA_MAX + 1));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::VOLTAGE_DELTA, 0));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::VOLTAGE_DELTA, RemoteConfig::VOLTAGE_DELTA_MAX + 1));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::BOOT_DELTA, 0));
+    // Checked against the other interval, which the command doesn't change
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::MIN_INTERVAL, DEFAULTS.maxInterval + 1));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyOne(RemoteConfig::MAX_INTERVAL, DEFAULTS.minInterval - 1));
+    TEST_ASSERT_TRUE(unchanged());
+}
+
+void test_all_or_nothing() {
+    const RemoteConfig::Param params[] = {RemoteConfig::RANGE_DELTA, RemoteConfig::BOOT_DELTA};
+    const uint32_t values[] = {35, 0};
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    size_t len = RemoteConfig::encodeCommand(1, params, values, 2, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL(RemoteConfig::OUT_OF_RANGE, applyCommand(buf, len));
+    TEST_ASSERT_TRUE(unchanged());
+
+    // Both intervals moved past the old ones in one command
+    const RemoteConfig::Param intervals[] = {RemoteConfig::MIN_INTERVAL, RemoteConfig::MAX_INTERVAL};
+    const uint32_t longer[] = {7200, 86400};
+    len = RemoteConfig::encodeCommand(1, intervals, longer, 2, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyCommand(buf, len));
+    TEST_ASSERT_EQUAL_UINT32(7200, settings.minInterval);
+    TEST_ASSERT_EQUAL_UINT32(86400, settings.maxInterval);
+}
+
+void test_unknown_param() {
+    const uint8_t buf[] = {1, 3, 0x00, 0x10, 6, 0x00, 0x01};
+    TEST_ASSERT_EQUAL(RemoteConfig::UNKNOWN_PARAM, applyCommand(buf, sizeof(buf)));
+    const uint8_t zero[] = {1, 0, 0x00, 0x10};
+    TEST_ASSERT_EQUAL(RemoteConfig::UNKNOWN_PARAM, applyCommand(zero, sizeof(zero)));
+    TEST_ASSERT_TRUE(unchanged());
+}
+
+void test_truncated_command() {
+    const RemoteConfig::Param params[] = {RemoteConfig::MIN_INTERVAL, RemoteConfig::RANGE_DELTA};
+    const uint32_t values[] = {120, 35};
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    size_t len = RemoteConfig::encodeCommand(1, params, values, 2, buf, sizeof(buf));
+    // Cut after the first parameter it is a valid command of its own
+    for (size_t cut = 0; cut < len; cut++) {
+        if (cut == 6) {
+            continue;
+        }
+        setUp();
+        TEST_ASSERT_EQUAL(RemoteConfig::BAD_LENGTH, applyCommand(buf, cut));
+        TEST_ASSERT_TRUE(unchanged());
+    }
+    uint8_t seq = 0xAA;
+    TEST_ASSERT_EQUAL(RemoteConfig::BAD_LENGTH, RemoteConfig::apply(buf, 0, settings, 0, &seq));
+    TEST_ASSERT_EQUAL_UINT8(0, seq);
+}
+
+void test_duplicate() {
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    const RemoteConfig::Param param = RemoteConfig::RANGE_DELTA;
+    uint32_t value = 35;
+    size_t len = RemoteConfig::encodeCommand(5, &param, &value, 1, buf, sizeof(buf));
+    uint8_t seq;
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, RemoteConfig::apply(buf, len, settings, 4, &seq));
+    TEST_ASSERT_EQUAL_UINT8(5, seq);
+
+    // The repeat is acked but not applied, even if it changed
+    value = 40;
+    len = RemoteConfig::encodeCommand(5, &param, &value, 1, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL(RemoteConfig::DUPLICATE, RemoteConfig::apply(buf, len, settings, 5, &seq));
+    TEST_ASSERT_EQUAL_UINT8(5, seq);
+    TEST_ASSERT_EQUAL_UINT16(35, settings.rangeDelta);
+
+    // A new number is applied, and 0 never counts as a repeat
+    len = RemoteConfig::encodeCommand(6, &param, &value, 1, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, RemoteConfig::apply(buf, len, settings, 5, &seq));
+    TEST_ASSERT_EQUAL_UINT16(40, settings.rangeDelta);
+    len = RemoteConfig::encodeCommand(0, &param, &value, 1, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, RemoteConfig::apply(buf, len, settings, 0, &seq));
+}
+
+void test_encode_limits() {
+    const RemoteConfig::Param params[] = {RemoteConfig::MIN_INTERVAL, RemoteConfig::MAX_INTERVAL, RemoteConfig::RANGE_DELTA,
+                                          RemoteConfig::VOLTAGE_DELTA, RemoteConfig::BOOT_DELTA};
+    const uint32_t values[] = {120, 7200, 35, 80, 100};
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    size_t len = RemoteConfig::encodeCommand(1, params, values, 5, buf, sizeof(buf));
+    // Every setting at once: the sequence number, 2 x 5 and 3 x 3 bytes
+    TEST_ASSERT_EQUAL(20, len);
+    TEST_ASSERT_LESS_OR_EQUAL(RemoteConfig::MAX_COMMAND_SIZE, len);
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, applyCommand(buf, len));
+
+    TEST_ASSERT_EQUAL(0, RemoteConfig::encodeCommand(1, params, values, 5, buf, len - 1));
+    TEST_ASSERT_EQUAL(0, RemoteConfig::encodeCommand(1, params, values, 0, buf, sizeof(buf)));
+    const RemoteConfig::Param unknown = (RemoteConfig::Param)9;
+    TEST_ASSERT_EQUAL(0, RemoteConfig::encodeCommand(1, &unknown, values, 1, buf, sizeof(buf)));
+    // A 2 byte setting can't carry a larger value
+    const RemoteConfig::Param boot = RemoteConfig::BOOT_DELTA;
+    const uint32_t tooLarge = 0x10001;
+    TEST_ASSERT_EQUAL(0, RemoteConfig::encodeCommand(1, &boot, &tooLarge, 1, buf, sizeof(buf)));
+}
+
+void test_ack_format() {
+    uint8_t buf[RemoteConfig::ACK_SIZE];
+    TEST_ASSERT_EQUAL(RemoteConfig::ACK_SIZE, RemoteConfig::encodeAck(7, RemoteConfig::OUT_OF_RANGE, buf, sizeof(buf)));
+    const uint8_t expected[] = {7, 3};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, RemoteConfig::ACK_SIZE);
+    TEST_ASSERT_EQUAL(0, RemoteConfig::encodeAck(7, RemoteConfig::OK, buf, RemoteConfig::ACK_SIZE - 1));
+
+    const RemoteConfig::Status statuses[] = {RemoteConfig::OK, RemoteConfig::UNKNOWN_PARAM, RemoteConfig::BAD_LENGTH,
+                                             RemoteConfig::OUT_OF_RANGE, RemoteConfig::DUPLICATE};
+    for (size_t i = 0; i < 5; i++) {
+        for (size_t j = i + 1; j < 5; j++) {
+            TEST_ASSERT_TRUE(strcmp(RemoteConfig::describe(statuses[i]), RemoteConfig::describe(statuses[j])) != 0);
+        }
+    }
+}
+
+void test_encoder_round_trip() {
+    const char *argv[] = {"--seq=42", "--max-interval=86400", "--min-interval=600", "--range-delta=15",
+                          "--voltage-delta=100", "--boot-delta=48"};
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    const char *error = NULL;
+    size_t len = parseCommand(6, argv, buf, sizeof(buf), &error);
+    TEST_ASSERT_EQUAL(20, len);
+
+    uint8_t seq;
+    TEST_ASSERT_EQUAL(RemoteConfig::OK, RemoteConfig::apply(buf, len, settings, 41, &seq));
+    TEST_ASSERT_EQUAL_UINT8(42, seq);
+    TEST_ASSERT_EQUAL_UINT32(600, settings.minInterval);
+    TEST_ASSERT_EQUAL_UINT32(86400, settings.maxInterval);
+    TEST_ASSERT_EQUAL_UINT16(15, settings.rangeDelta);
+    TEST_ASSERT_EQUAL_UINT16(100, settings.voltageDelta);
+    TEST_ASSERT_EQUAL_UINT16(48, settings.bootDelta);
+
+    // The ack in front of an uplink payload, as printed by the network server
+    uint8_t ack[RemoteConfig::ACK_SIZE];
+    RemoteConfig::encodeAck(seq, RemoteConfig::DUPLICATE, ack, sizeof(ack));
+    char hex[16];
+    snprintf(hex, sizeof(hex), "%02x%02X0184", ack[0], ack[1]);
+    RemoteConfig::Status status;
+    TEST_ASSERT_TRUE(parseAck(hex, &seq, &status));
+    TEST_ASSERT_EQUAL_UINT8(42, seq);
+    TEST_ASSERT_EQUAL(RemoteConfig::DUPLICATE, status);
+}
+
+void test_encoder_errors() {
+    uint8_t buf[RemoteConfig::MAX_COMMAND_SIZE];
+    const char *error;
+    const char *noSeq[] = {"--range-delta=15"};
+    TEST_ASSERT_EQUAL(0, parseCommand(1, noSeq, buf, sizeof(buf), &error));
+    const char *seqZero[] = {"--seq=0", "--range-delta=15"};
+    TEST_ASSERT_EQUAL(0, parseCommand(2, seqZero, buf, sizeof(buf), &error));
+    const char *seqLarge[] = {"--seq=256", "--range-delta=15"};
+    TEST_ASSERT_EQUAL(0, parseCommand(2, seqLarge, buf, sizeof(buf), &error));
+    const char *nothing[] = {"--seq=1"};
+    TEST_ASSERT_EQUAL(0, parseCommand(1, nothing, buf, sizeof(buf), &error));
+    const char *unknown[] = {"--seq=1", "--range=15"};
+    TEST_ASSERT_EQUAL(0, parseCommand(2, unknown, buf, sizeof(buf), &error));
+    const char *twice[] = {"--seq=1", "--range-delta=15", "--range-delta=20"};
+    TEST_ASSERT_EQUAL(0, parseCommand(3, twice, buf, sizeof(buf), &error));
+    const char *notNumber[] = {"--seq=1", "--range-delta=15mm"};
+    TEST_ASSERT_EQUAL(0, parseCommand(2, notNumber, buf, sizeof(buf), &error));
+    const char *negative[] = {"--seq=1", "--range-delta=-15"};
+    TEST_ASSERT_EQUAL(0, parseCommand(2, negative, buf, sizeof(buf), &error));
+    const char *tooLarge[] = {"--seq=1", "--boot-delta=65537"};
+    TEST_ASSERT_EQUAL(0, parseCommand(2, tooLarge, buf, sizeof(buf), &error));
+    // Rejected the way the firmware would
+    const char *outOfRange[] = {"--seq=1", "--min-interval=59"};
+    TEST_ASSERT_EQUAL(0, parseCommand(2, outOfRange, buf, sizeof(buf), &error));
+    TEST_ASSERT_EQUAL_STRING(RemoteConfig::describe(RemoteConfig::OUT_OF_RANGE), error);
+
+    uint8_t seq;
+    RemoteConfig::Status status;
+    TEST_ASSERT_FALSE(parseAck("07", &seq, &status));
+    TEST_ASSERT_FALSE(parseAck("07g0", &seq, &status));
+    TEST_ASSERT_FALSE(parseAck("", &seq, &status));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_command_layout);
+    RUN_TEST(test_each_setting);
+    RUN_TEST(test_bounds);
+    RUN_TEST(test_all_or_nothing);
+    RUN_TEST(test_unknown_param);
+    RUN_TEST(test_truncated_command);
+    RUN_TEST(test_duplicate);
+    RUN_TEST(test_encode_limits);
+    RUN_TEST(test_ack_format);
+    RUN_TEST(test_encoder_round_trip);
+    RUN_TEST(test_encoder_errors);
+    return UNITY_END();
+}
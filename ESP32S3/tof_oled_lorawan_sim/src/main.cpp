@@ -0,0 +1,837 @@
+/*
+ * Host simulator for the wake cycle of tof_oled_lorawan. It replays a long
+ * period of wakes against a synthetic water level and estimates the energy
+ * used per day and the resulting battery life. It also reports how long it
+ * takes to see a level change, run with --fixed-sleep=1 --range-watch=0 to
+ * compare against a fixed interval.
+ *
+ * The decisions are the firmware's own: WakeCycle decides what to send,
+ * retries and picks the sleep time, LinkTuner the data rate and TX power,
+ * on top of WakeScheduler, SendPolicy and DepthPayload. Only the radio, the
+ * sensor and the water are simulated.
+ *
+ * Each wake is split into phases that each have their own current draw.
+ * Everything (settings, phase currents and durations) can be changed from
+ * the command line, see --help. Runs with the same settings and seed give
+ * the same results.
+ *
+ * With --trace=<csv> the level comes from recorded ranges instead, one
+ * `seconds,range_mm` line per sample. The sensor reads the range
+ * interpolated between the samples, and the run ends with the trace.
+ */
+
+#include <DepthPayload.h>
+#include <LinkTuner.h>
+#include <RemoteConfig.h>
+#include <SendPolicy.h>
+#include <WakeCycle.h>
+#include <WakeScheduler.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+const double SECONDS_PER_DAY = 24 * 60 * 60;
+
+// Step (seconds) at which the level is checked for changes during sleep
+const double LEVEL_CHECK_STEP = 60;
+
+// Everything that can be changed from the command line
+struct Setting {
+    const char *name;
+    double value;
+    const char *help;
+};
+
+Setting settings[] = {
+    {"days", 365, "Number of days to simulate"},
+    {"seed", 1, "Seed for the random generator"},
+    // Firmware configuration
+    {"min-sleep", 15 * 60, "DSLEEP_MIN_TIME_MS in seconds"},
+    {"max-sleep", 24 * 60 * 60, "DSLEEP_TIME_MS in seconds"},
+    {"fixed-sleep", 0, "1 to always sleep max-sleep instead of using the WakeScheduler"},
+    {"range-delta", 50, "RANGE_SIGNIFICANT_DELTA (mm)"},
+    {"voltage-delta", 100, "VOLTAGE_SIGNIFICANT_DELTA (mV)"},
+    {"flush-count", 12, "READINGS_FLUSH_COUNT"},
+    {"boot-delta", 30, "BOOTCOUNT_SIGNIFICANT_DELTA"},
+    {"burst", 5, "Readings per RangeFilter burst"},
+    {"read-retries", 5, "READ_MAX_RETRIES"},
+    {"read-retry-delay", 500, "READ_RETRY_DELAY (ms)"},
+    {"join-retries", 3, "JOIN_MAX_RETRIES"},
+    {"join-retry-delay", 15000, "JOIN_RETRY_DELAY (ms)"},
+    {"join-backoff-max", 60 * 60 * 1000, "Upper limit of the join backoff (ms)"},
+    {"send-retries", 6, "SEND_MAX_RETRIES"},
+    {"send-retry-delay", 5000, "SEND_RETRY_DELAY (ms)"},
+    {"send-backoff-max", 10 * 60 * 1000, "Upper limit of the send backoff (ms)"},
+    {"jitter", 25, "Random part of the backoff (%)"},
+    {"light-sleep-max", 10000, "Longest backoff (ms) spent in light sleep, longer ones get a wake of their own"},
+    {"payload-version", DepthPayload::VERSION_FIXED, "PAYLOAD_VERSION of single readings"},
+    {"range-watch", 1, "RANGE_WATCH, 1 to let the sensor wake us when the level moves"},
+    {"watch-period", 30, "RANGE_WATCH_PERIOD_MS in seconds"},
+    {"heartbeat-days", 7, "HEARTBEAT_DAYS, timer wake while the sensor watches"},
+    {"target-margin", 10, "Link margin (dB) LinkTuner keeps"},
+    {"initial-dr", 3, "Data rate until the first link check"},
+    {"min-power", 2, "Lowest TX power (dBm)"},
+    {"max-power", 16, "Highest TX power (dBm)"},
+    {"link-check-interval", 8, "Uplinks between link checks"},
+    {"counters-flush", 16, "COUNTERS_FLUSH_WAKES"},
+    {"low-battery", 3400, "LOW_BATTERY_MV"},
+    // Environment
+    {"join-rate", 0.9, "Chance that a join succeeds"},
+    {"send-rate", 0.95, "Chance that the radio sends an uplink"},
+    {"read-fail-rate", 0.02, "Chance that a range burst is rejected"},
+    {"snr", 0, "SNR (dB) of uplinks at the gateway at max-power"},
+    {"fading", 3, "Change of the SNR from uplink to uplink (dB, standard deviation)"},
+    {"commands-per-week", 0.25, "Average number of RemoteConfig commands sent to the device"},
+    {"noise", 3, "Sensor noise (mm, standard deviation)"},
+    {"season", 300, "Amplitude of the yearly level change (mm)"},
+    {"rain-per-week", 1, "Average number of rain events per week"},
+    {"rain-rise", 250, "Average level rise of a rain event (mm)"},
+    {"mount-height", 2000, "Distance from the sensor to the bottom (mm)"},
+    {"capacity", 2600, "Battery capacity (mAh)"},
+    // Current profile, all currents are for the whole board
+    {"sleep-ua", 25, "Deep sleep current (uA)"},
+    {"boot-ma", 40, "Current while booting and opening NVS (mA)"},
+    {"boot-ms", 150, "Time to boot and open NVS (ms)"},
+    {"sensor-ma", 45, "Current while initialising the sensor (mA)"},
+    {"sensor-ms", 30, "Time to initialise the sensor (ms)"},
+    {"range-ma", 55, "Current while ranging (mA)"},
+    {"range-ms", 70, "Time for a single reading (ms)"},
+    {"radio-ma", 40, "Current while initialising the radio (mA)"},
+    {"radio-ms", 50, "Time to initialise the radio (ms)"},
+    {"tx-ma", 120, "Current while transmitting at max-power (mA)"},
+    {"tx-min-ma", 40, "Current while transmitting at min-power (mA)"},
+    {"rx-ma", 42, "Current while waiting for and in the receive windows (mA)"},
+    {"rx-ms", 2100, "Time spent on the receive windows of an uplink (ms)"},
+    {"join-rx-ms", 6100, "Time spent on the receive windows of a join (ms)"},
+    {"wait-ma", 32, "Current during retry delays (mA)"},
+    {"light-sleep-ma", 1.5, "Current in light sleep between retries (mA)"},
+    {"watch-ua", 20, "Extra deep sleep current while the sensor watches the level (uA)"},
+    {"nvs-ma", 40, "Current while writing to NVS (mA)"},
+    {"nvs-ms", 8, "Time for a single NVS write (ms)"},
+    {"shutdown-ma", 35, "Current while going to sleep (mA)"},
+    {"shutdown-ms", 20, "Time to go to sleep (ms)"},
+};
+
+// A recorded range, see --trace
+struct TraceSample {
+    double time;   // Seconds since the first sample
+    double range;  // mm
+};
+
+const char *tracePath = NULL;
+std::vector<TraceSample> trace;
+
+double setting(const char *name) {
+    for (const Setting &s : settings) {
+        if (strcmp(s.name, name) == 0) {
+            return s.value;
+        }
+    }
+    fprintf(stderr, "Unknown setting %s\n", name);
+    exit(2);
+}
+
+void usage() {
+    printf("Usage: program [--trace=<csv>] [--<setting>=<value>]...\n\n");
+    printf("  --%-18s %s\n\nSettings (default):\n", "trace", "Recorded `seconds,range_mm` lines to replay instead of the synthetic level");
+    for (const Setting &s : settings) {
+        printf("  --%-18s %s (%g)\n", s.name, s.help, s.value);
+    }
+}
+
+bool parseArgs(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *eq = strchr(arg, '=');
+        if (strncmp(arg, "--", 2) != 0 || eq == NULL) {
+            return false;
+        }
+        if (strncmp(arg, "--trace=", 8) == 0) {
+            tracePath = eq + 1;
+            continue;
+        }
+        bool found = false;
+        for (Setting &s : settings) {
+            if (strlen(s.name) == (size_t)(eq - arg - 2) && strncmp(s.name, arg + 2, eq - arg - 2) == 0) {
+                s.value = atof(eq + 1);
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the samples of a trace, lines that don't start with two numbers
+// (a header, comments) are skipped. Times have to go up.
+bool loadTrace(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return false;
+    }
+    char line[256];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        double time, range;
+        if (sscanf(line, " %lf , %lf", &time, &range) != 2) {
+            continue;
+        }
+        if (!trace.empty() && time <= trace.back().time) {
+            fprintf(stderr, "%s:%d: time doesn't go up\n", path, lineNumber);
+            ok = false;
+        }
+        trace.push_back({time, range});
+    }
+    fclose(file);
+    if (ok && trace.size() < 2) {
+        fprintf(stderr, "%s: needs at least two samples\n", path);
+        ok = false;
+    }
+    for (size_t i = 1; ok && i < trace.size(); i++) {
+        trace[i].time -= trace[0].time;
+    }
+    if (ok) {
+        trace[0].time = 0;
+    }
+    return ok;
+}
+
+// Where the time of a wake goes, each phase has its own current
+enum Phase {
+    PHASE_BOOT,
+    PHASE_SENSOR,
+    PHASE_RANGE,
+    PHASE_RADIO,
+    PHASE_TX,
+    PHASE_RX,
+    PHASE_WAIT,
+    PHASE_LIGHT_SLEEP,
+    PHASE_NVS,
+    PHASE_SHUTDOWN,
+    PHASE_SLEEP,
+    PHASE_WATCH,
+    PHASE_COUNT
+};
+
+const char *PHASE_NAMES[PHASE_COUNT] = {"boot", "sensor", "range", "radio", "tx", "rx", "wait", "lsleep", "nvs", "shutdown", "sleep", "watch"};
+
+struct Totals {
+    double phaseMs[PHASE_COUNT];
+    double phaseMah[PHASE_COUNT];
+    uint32_t wakes;
+    uint32_t uplinks;
+    uint32_t failedUplinks;
+    uint32_t lostUplinks;  // Sent, but no gateway heard it
+    uint32_t ackUplinks;
+    uint32_t linkChecks;
+    uint32_t joins;
+    uint32_t failedJoins;
+    uint32_t retryWakes;
+    uint32_t sensorWakes;
+    uint32_t heartbeatWakes;
+    double uplinkSf;
+    double uplinkPower;
+    uint32_t readings;
+    uint32_t lostReadings;
+    double emptyDay;  // Day the battery ran out, 0 if it didn't
+};
+
+double phaseCurrent(Phase phase) {
+    switch (phase) {
+        case PHASE_BOOT:
+            return setting("boot-ma");
+        case PHASE_SENSOR:
+            return setting("sensor-ma");
+        case PHASE_RANGE:
+            return setting("range-ma");
+        case PHASE_RADIO:
+            return setting("radio-ma");
+        case PHASE_TX:
+            return setting("tx-ma");
+        case PHASE_RX:
+            return setting("rx-ma");
+        case PHASE_WAIT:
+            return setting("wait-ma");
+        case PHASE_LIGHT_SLEEP:
+            return setting("light-sleep-ma");
+        case PHASE_NVS:
+            return setting("nvs-ma");
+        case PHASE_SHUTDOWN:
+            return setting("shutdown-ma");
+        case PHASE_WATCH:
+            return setting("watch-ua") / 1000;
+        default:
+            return setting("sleep-ua") / 1000;
+    }
+}
+
+// Time on air (ms) of a LoRa frame with `len` bytes of application payload
+// at 125 kHz, coding rate 4/5, 8 symbol preamble and explicit header
+double airtimeMs(size_t len, int sf) {
+    const size_t LORAWAN_OVERHEAD = 13;
+    double symbolMs = (1 << sf) / 125.0;
+    int lowRate = sf >= 11 ? 1 : 0;
+    double bits = 8.0 * (len + LORAWAN_OVERHEAD) - 4 * sf + 28 + 16;
+    double symbols = 8 + fmax(ceil(bits / (4 * (sf - 2 * lowRate))) * 5, 0);
+    return (8 + 4.25 + symbols) * symbolMs;
+}
+
+// Deterministic random numbers, independent of the standard library
+class Random {
+   public:
+    explicit Random(uint32_t seed) : engine(seed) {}
+
+    double uniform() {
+        return engine() / 4294967296.0;
+    }
+
+    uint32_t next() {
+        return engine();
+    }
+
+    bool chance(double p) {
+        return uniform() < p;
+    }
+
+    double normal(double stddev) {
+        // Box-Muller
+        double u = 1.0 - uniform();
+        double v = uniform();
+        return stddev * sqrt(-2.0 * log(u)) * cos(2 * M_PI * v);
+    }
+
+    double exponential(double mean) {
+        return -mean * log(1.0 - uniform());
+    }
+
+   private:
+    std::mt19937 engine;
+};
+
+// Synthetic water level: a yearly cycle plus rain events that make the
+// level rise over a few hours and then slowly drop again. Follows the
+// trace instead when there is one.
+class Level {
+   public:
+    Level(Random &random, double days) {
+        if (!trace.empty()) {
+            return;
+        }
+        double perSecond = setting("rain-per-week") / (7 * SECONDS_PER_DAY);
+        if (perSecond <= 0) {
+            return;
+        }
+        for (double t = random.exponential(1 / perSecond); t < days * SECONDS_PER_DAY; t += random.exponential(1 / perSecond)) {
+            rains.push_back({t, random.exponential(setting("rain-rise"))});
+        }
+    }
+
+    // Level above the bottom in mm at `t` seconds
+    double at(double t) const {
+        if (!trace.empty()) {
+            return setting("mount-height") - traced(t);
+        }
+        const double RISE_TIME = 6 * 60 * 60;
+        const double DRAIN_TIME = 2 * SECONDS_PER_DAY;
+        double level = setting("mount-height") / 2 + setting("season") * sin(2 * M_PI * t / (365 * SECONDS_PER_DAY));
+        for (const Rain &rain : rains) {
+            if (rain.start > t) {
+                break;
+            }
+            double dt = t - rain.start;
+            if (dt < RISE_TIME) {
+                level += rain.rise * dt / RISE_TIME;
+            } else {
+                level += rain.rise * exp(-(dt - RISE_TIME) / DRAIN_TIME);
+            }
+        }
+        return level;
+    }
+
+   private:
+    struct Rain {
+        double start;
+        double rise;
+    };
+
+    // Range of the trace at `t`, interpolated between the samples
+    static double traced(double t) {
+        auto next = std::upper_bound(trace.begin(), trace.end(), t, [](double time, const TraceSample &s) { return time < s.time; });
+        if (next == trace.begin()) {
+            return next->range;
+        }
+        if (next == trace.end()) {
+            return trace.back().range;
+        }
+        const TraceSample &prev = *(next - 1);
+        return prev.range + (next->range - prev.range) * (t - prev.time) / (next->time - prev.time);
+    }
+
+    std::vector<Rain> rains;
+};
+
+// Device state that the firmware keeps across deep sleep
+struct Device {
+    uint16_t bootCount;
+    WakeCycle cycle;
+    WakeScheduler wakeScheduler;
+    LinkTuner linkTuner;
+    bool hasSession;
+    uint16_t wakesSinceFlush;
+};
+
+// SNR (dB) the SX126x needs to demodulate a spreading factor
+double demodulationFloor(int sf) {
+    return -7.5 - 2.5 * (sf - 7);
+}
+
+// Largest application payload of a data rate in EU868
+size_t datarateMaxPayload(uint8_t dr) {
+    if (dr <= 2) {
+        return 51;
+    }
+    return dr == 3 ? 115 : 222;
+}
+
+// Runs the wakes, the radio side of WakeCycle is simulated here
+class Simulator : private WakeCycle::Link {
+   public:
+    Simulator()
+        : rng((uint32_t)setting("seed")),
+          days(trace.empty() ? setting("days") : fmin(setting("days"), trace.back().time / SECONDS_PER_DAY)),
+          level(rng, days),
+          totals(),
+          device(),
+          watching(false),
+          commandSeq(0),
+          referenceLevel(NAN),
+          changeStart(-1) {
+        device.cycle.setShared({SendPolicy::NO_RANGE, 0, 0});
+        // Make sure the counters get written on the first boot
+        device.wakesSinceFlush = (uint16_t)setting("counters-flush");
+        wakeSchedule = {(uint32_t)setting("min-sleep"), (uint32_t)setting("max-sleep"), (uint16_t)setting("range-delta")};
+        if (setting("fixed-sleep") != 0) {
+            wakeSchedule.minInterval = wakeSchedule.maxInterval;
+        }
+        sendPolicy = {(uint16_t)setting("range-delta"), (uint16_t)setting("voltage-delta"), (uint8_t)setting("flush-count"), (uint16_t)setting("boot-delta")};
+        wakeCycle = {
+            {(uint32_t)setting("join-retry-delay"), (uint32_t)setting("join-backoff-max"), (uint8_t)setting("jitter"), (uint8_t)setting("join-retries")},
+            {(uint32_t)setting("send-retry-delay"), (uint32_t)setting("send-backoff-max"), (uint8_t)setting("jitter"), (uint8_t)setting("send-retries")},
+            (uint32_t)setting("light-sleep-max"),
+            (uint8_t)setting("payload-version"),
+            2,  // LORAWAN_UPLINK_USER_PORT
+            0,
+            (uint32_t)(setting("heartbeat-days") * SECONDS_PER_DAY),
+        };
+        // DR0 to DR5 is SF12 to SF7 like in EU868
+        linkTuning = {(int8_t)setting("target-margin"), 0, 5, (uint8_t)setting("initial-dr"), (int8_t)setting("min-power"), (int8_t)setting("max-power"), (uint8_t)setting("link-check-interval")};
+        nextCommand = commandInterval();
+    }
+
+    void run() {
+        double end = days * SECONDS_PER_DAY;
+        double t = 0;
+        bool timerWake = true;
+        while (t < end) {
+            double sleepTime = wake(t, timerWake) / 1000.0;
+            t += wakeMs / 1000;
+            double until = fmin(t + sleepTime, end);
+            double woken = watching ? watchUntil(t, until) : until;
+            timerWake = woken >= until;
+            spend(PHASE_SLEEP, (woken - t) * 1000);
+            if (watching) {
+                spend(PHASE_WATCH, (woken - t) * 1000);
+            }
+            watchLevel(t, woken);
+            t = woken;
+        }
+    }
+
+    void report() const {
+        double total = 0;
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            total += totals.phaseMah[i];
+        }
+        double perDay = total / days;
+        double awakeMs = 0;
+        for (int i = 0; i < PHASE_SLEEP; i++) {
+            awakeMs += totals.phaseMs[i];
+        }
+        uint32_t sent = totals.uplinks - totals.failedUplinks;
+
+        printf("Simulated days:       %.0f\n", days);
+        printf("Wakes:                %u (%.1f/day)\n", totals.wakes, totals.wakes / days);
+        printf("  by the sensor:      %u\n", totals.sensorWakes);
+        printf("  heartbeats:         %u\n", totals.heartbeatWakes);
+        printf("  retries:            %u\n", totals.retryWakes);
+        printf("Average awake (ms):   %.0f\n", totals.wakes ? awakeMs / totals.wakes : 0);
+        printf("Readings:             %u (%u lost)\n", totals.readings, totals.lostReadings);
+        printf("Uplinks:              %u (%.2f/day, %u failed, %u not heard)\n", totals.uplinks, totals.uplinks / days, totals.failedUplinks,
+               totals.lostUplinks);
+        printf("  acknowledgements:   %u\n", totals.ackUplinks);
+        printf("  link checks:        %u\n", totals.linkChecks);
+        if (sent > 0) {
+            printf("  average SF/dBm:     %.1f/%.1f\n", totals.uplinkSf / sent, totals.uplinkPower / sent);
+        }
+        printf("Joins:                %u (%u failed)\n", totals.joins, totals.failedJoins);
+        reportLatency();
+        printf("Energy (mAh/day):     %.3f\n", perDay);
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            printf("  %-9s %9.3f mAh/day %5.1f%%\n", PHASE_NAMES[i], totals.phaseMah[i] / days, total > 0 ? 100 * totals.phaseMah[i] / total : 0);
+        }
+        if (totals.emptyDay > 0) {
+            printf("Battery ran out on day %.0f\n", totals.emptyDay);
+        }
+        printf("Battery life (days):  %.0f\n", perDay > 0 ? setting("capacity") / perDay : INFINITY);
+    }
+
+   private:
+    // A level change is a move of range-delta away from the level the
+    // network was last sent, or the last change that was seen. Its latency
+    // is the time from the moment the level got there until a wake reads
+    // it.
+    void reportLatency() const {
+        std::vector<double> sorted = latencies;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (double latency : sorted) {
+            sum += latency;
+        }
+        size_t count = sorted.size();
+        printf("Level changes:        %zu (%.2f/day)\n", count, count / days);
+        if (count > 0) {
+            printf("Detection latency:    mean %.0f min, p95 %.0f min, max %.0f min\n", sum / count / 60,
+                   sorted[(count * 95 + 99) / 100 - 1] / 60, sorted.back() / 60);
+        }
+    }
+
+    // Looks for the start of a level change while the device sleeps
+    void watchLevel(double from, double to) {
+        if (changeStart >= 0 || isnan(referenceLevel)) {
+            return;
+        }
+        for (double t = from; t < to; t += LEVEL_CHECK_STEP) {
+            if (fabs(level.at(t) - referenceLevel) >= setting("range-delta")) {
+                changeStart = t;
+                return;
+            }
+        }
+    }
+
+    // Called for every wake that reads the range
+    void detectChange(double now) {
+        double current = level.at(now);
+        if (isnan(referenceLevel)) {
+            referenceLevel = current;
+            return;
+        }
+        if (changeStart < 0 && fabs(current - referenceLevel) >= setting("range-delta")) {
+            // Started after the last check
+            changeStart = now;
+        }
+        if (changeStart >= 0) {
+            latencies.push_back(now - changeStart);
+            changeStart = -1;
+            referenceLevel = current;
+        }
+    }
+
+    // Changes are looked for from the level of the reading the network got
+    // last, also when it was sent for another reason than a change
+    void levelShared() {
+        uint16_t bootCount = device.cycle.shared().bootCount;
+        for (const ReadingTime &reading : readingTimes) {
+            if (reading.bootCount == bootCount) {
+                referenceLevel = level.at(reading.time);
+            }
+        }
+    }
+
+    // Time the sensor sees the range leave the watched band, or `until`
+    double watchUntil(double from, double until) {
+        for (double t = from + setting("watch-period"); t < until; t += setting("watch-period")) {
+            uint16_t range = rangeAt(t);
+            if (range < watchLow || range > watchHigh) {
+                return t;
+            }
+        }
+        return until;
+    }
+
+    // Runs through a single wake at `now` seconds and returns the sleep time
+    // in ms
+    uint64_t wake(double now, bool timerWake) {
+        wakeStart = now;
+        wakeMs = 0;
+        totals.wakes++;
+        device.bootCount++;
+        device.wakesSinceFlush++;
+        if (!timerWake) {
+            totals.sensorWakes++;
+        }
+        device.cycle.begin(timerWake);
+        if (device.cycle.heartbeatWake()) {
+            totals.heartbeatWakes++;
+        }
+        sessionRestored = device.hasSession;
+        spend(PHASE_BOOT, setting("boot-ms"));
+
+        uint16_t voltage = batteryVoltage(now);
+        uint16_t range = SendPolicy::NO_RANGE;
+        if (device.cycle.retryWake()) {
+            totals.retryWakes++;
+            range = device.cycle.readings().newest().range;
+            spend(PHASE_RADIO, setting("radio-ms"));
+            updatePayload(range, voltage);
+        } else {
+            spend(PHASE_SENSOR, setting("sensor-ms"));
+            range = readRangeWithRetries(now);
+            if (range != SendPolicy::NO_RANGE) {
+                device.wakeScheduler.update(wakeSchedule, (uint32_t)now, range);
+                detectChange(now);
+            }
+            spend(PHASE_RADIO, setting("radio-ms"));
+            if (range != SendPolicy::NO_RANGE) {
+                updatePayload(range, voltage);
+            }
+        }
+
+        watching = setting("range-watch") != 0 && device.cycle.watchBand(sendPolicy.rangeDelta, range, &watchLow, &watchHigh);
+        if (device.wakesSinceFlush >= setting("counters-flush") || voltage < setting("low-battery")) {
+            spend(PHASE_NVS, setting("nvs-ms"));
+            device.wakesSinceFlush = 0;
+        }
+        spend(PHASE_SHUTDOWN, setting("shutdown-ms"));
+        return device.cycle.sleepTime(wakeCycle, device.wakeScheduler, wakeSchedule, watching);
+    }
+
+    uint16_t readRangeWithRetries(double now) {
+        for (int i = 0; i < setting("read-retries"); i++) {
+            spend(PHASE_RANGE, setting("burst") * setting("range-ms"));
+            if (!rng.chance(setting("read-fail-rate"))) {
+                return rangeAt(now);
+            }
+            spend(PHASE_WAIT, setting("read-retry-delay"));
+        }
+        return SendPolicy::NO_RANGE;
+    }
+
+    // What the sensor measures at `t`, in whole mm like the sensor
+    uint16_t rangeAt(double t) {
+        double range = setting("mount-height") - level.at(t) + rng.normal(setting("noise"));
+        return (uint16_t)lround(fmax(0, fmin(range, 0xfffe)));
+    }
+
+    void updatePayload(uint16_t range, uint16_t voltage) {
+        if (!device.cycle.retryWake()) {
+            if (device.cycle.readings().count() == ReadingBuffer::CAPACITY) {
+                totals.lostReadings++;
+            }
+            totals.readings++;
+            readingTimes.push_back({device.bootCount, wakeStart});
+            if (readingTimes.size() > ReadingBuffer::CAPACITY) {
+                readingTimes.erase(readingTimes.begin());
+            }
+            SendPolicy::Reason reason;
+            if (!device.cycle.addReading(sendPolicy, {range, voltage, device.bootCount}, &reason)) {
+                return;
+            }
+        }
+        switch (device.cycle.send(wakeCycle, *this)) {
+            case WakeCycle::SENT:
+                levelShared();
+                // The session, and the link settings when they changed
+                spend(PHASE_NVS, setting("nvs-ms"));
+                if (device.linkTuner.changed()) {
+                    spend(PHASE_NVS, setting("nvs-ms"));
+                    device.linkTuner.clearChanged();
+                }
+                break;
+            case WakeCycle::RETRY_LATER:
+                if (sessionRestored && device.hasSession) {
+                    // The network might not know about our session anymore
+                    device.hasSession = false;
+                    spend(PHASE_NVS, setting("nvs-ms"));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool join() {
+        if (device.hasSession) {
+            return true;
+        }
+        totals.joins++;
+        // Join request is 23 bytes, the 13 bytes of overhead are included
+        spendTx(airtimeMs(23 - 13, sf()));
+        spend(PHASE_RX, setting("join-rx-ms"));
+        // Nonces are saved whether or not the join worked
+        spend(PHASE_NVS, setting("nvs-ms"));
+        if (!rng.chance(setting("join-rate"))) {
+            totals.failedJoins++;
+            return false;
+        }
+        device.hasSession = true;
+        spend(PHASE_NVS, setting("nvs-ms"));
+        return true;
+    }
+
+    size_t maxPayloadLen() {
+        return datarateMaxPayload(device.linkTuner.datarate(linkTuning));
+    }
+
+    bool send(const uint8_t *payload, size_t len, uint8_t port) {
+        (void)payload;
+        bool linkCheck = device.linkTuner.wantLinkCheck(linkTuning);
+        // The LinkCheckReq goes in FOpts
+        spendTx(airtimeMs(len + (linkCheck ? 1 : 0), sf()));
+        spend(PHASE_RX, setting("rx-ms"));
+        totals.uplinks++;
+        if (!rng.chance(setting("send-rate"))) {
+            totals.failedUplinks++;
+            return false;
+        }
+        if (port == RemoteConfig::PORT) {
+            totals.ackUplinks++;
+        }
+        totals.uplinkSf += sf();
+        totals.uplinkPower += device.linkTuner.txPower(linkTuning);
+
+        // Uplinks are unconfirmed, one that no gateway heard still counts as
+        // sent, only a link check notices
+        double snr = setting("snr") - (setting("max-power") - device.linkTuner.txPower(linkTuning)) + rng.normal(setting("fading"));
+        double margin = snr - demodulationFloor(sf());
+        bool heard = margin >= 0;
+        if (!heard) {
+            totals.lostUplinks++;
+        }
+        device.linkTuner.uplinkSent();
+        if (linkCheck) {
+            totals.linkChecks++;
+            if (heard) {
+                device.linkTuner.linkCheck(linkTuning, (uint8_t)fmin(margin, 254));
+            } else {
+                device.linkTuner.linkCheckMissed(linkTuning);
+            }
+        }
+        // Commands wait at the network server until an uplink is heard, the
+        // downlink comes in RX1
+        double now = wakeStart + wakeMs / 1000;
+        if (heard && now >= nextCommand) {
+            nextCommand = now + commandInterval();
+            if (!linkCheck) {
+                // The gateway transmits at full power, it's only the fading
+                device.linkTuner.downlink(linkTuning, setting("snr") + rng.normal(setting("fading")));
+            }
+            device.cycle.acknowledge(commandSeq++, RemoteConfig::OK);
+        }
+        return true;
+    }
+
+    void lightSleep(uint32_t ms) {
+        spend(PHASE_LIGHT_SLEEP, ms);
+    }
+
+    uint32_t random() {
+        return rng.next();
+    }
+
+    double commandInterval() {
+        double perWeek = setting("commands-per-week");
+        return perWeek > 0 ? rng.exponential(7 * SECONDS_PER_DAY / perWeek) : INFINITY;
+    }
+
+    // Battery voltage from the charge that is left, roughly linear for LiPo
+    uint16_t batteryVoltage(double now) {
+        double used = 0;
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            used += totals.phaseMah[i];
+        }
+        double left = fmax(0, 1 - used / setting("capacity"));
+        if (left == 0 && totals.emptyDay == 0) {
+            totals.emptyDay = now / SECONDS_PER_DAY + 1;
+        }
+        return (uint16_t)(3300 + 900 * left);
+    }
+
+    int sf() const {
+        return 12 - (device.linkTuner.datarate(linkTuning) - linkTuning.minDatarate);
+    }
+
+    void spend(Phase phase, double ms) {
+        spend(phase, ms, phaseCurrent(phase));
+    }
+
+    // The transmit current goes down with the TX power
+    void spendTx(double ms) {
+        double span = setting("max-power") - setting("min-power");
+        double part = span > 0 ? (device.linkTuner.txPower(linkTuning) - setting("min-power")) / span : 1;
+        spend(PHASE_TX, ms, setting("tx-min-ma") + part * (setting("tx-ma") - setting("tx-min-ma")));
+    }
+
+    void spend(Phase phase, double ms, double ma) {
+        totals.phaseMs[phase] += ms;
+        totals.phaseMah[phase] += ma * ms / 3600000.0;
+        if (phase != PHASE_SLEEP && phase != PHASE_WATCH) {
+            wakeMs += ms;
+        }
+    }
+
+    Random rng;
+    double days;
+    Level level;
+    Totals totals;
+    Device device;
+    WakeScheduler::Config wakeSchedule;
+    SendPolicy::Config sendPolicy;
+    WakeCycle::Config wakeCycle;
+    LinkTuner::Config linkTuning;
+    double wakeStart;  // Seconds
+    double wakeMs;
+    bool sessionRestored;
+    bool watching;
+    uint16_t watchLow;
+    uint16_t watchHigh;
+    double nextCommand;  // Seconds
+    uint8_t commandSeq;
+    // When the readings that may still be sent were taken
+    struct ReadingTime {
+        uint16_t bootCount;
+        double time;
+    };
+    std::vector<ReadingTime> readingTimes;
+    double referenceLevel;
+    double changeStart;  // Seconds, negative while the level hasn't changed
+    std::vector<double> latencies;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (!parseArgs(argc, argv)) {
+        usage();
+        return argc > 1 && strcmp(argv[1], "--help") == 0 ? 0 : 2;
+    }
+    if (tracePath != NULL && !loadTrace(tracePath)) {
+        return 2;
+    }
+    Simulator simulator;
+    simulator.run();
+    simulator.report();
+    return 0;
+}
@@ -2,4 +2,12 @@
 
 #include <Arduino.h>
 
-void goToSleep(uint32_t timeoutMs);
\ No newline at end of file
+/**
+ * @brief Sleep in STOP2 for the given time, woken by the RTC
+ *
+ * Any duration can be slept: long ones are split into RTC wakeup periods
+ * that go straight back to STOP2 without restoring the clocks.
+ * @param timeoutMs Time to sleep in milliseconds
+ * @return Time actually slept in milliseconds, measured with the RTC
+ */
+uint32_t goToSleep(uint32_t timeoutMs);
\ No newline at end of file
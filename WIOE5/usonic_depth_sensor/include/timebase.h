@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Milliseconds since boot, including the time spent in STOP2
+ *
+ * millis() stops while the SysTick is suspended for STOP2, the time slept
+ * is measured by the LSE-clocked RTC and added on top. Use this instead of
+ * millis() for anything that spans more than one wake.
+ * @return Monotonic uptime in milliseconds
+ */
+uint64_t uptimeMs();
+
+/**
+ * @brief Add time that passed while the SysTick was suspended
+ * @param sleptMs Time slept in milliseconds, as measured by the RTC
+ */
+void addSleepTime(uint32_t sleptMs);
\ No newline at end of file
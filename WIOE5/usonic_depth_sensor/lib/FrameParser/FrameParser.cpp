@@ -0,0 +1,48 @@
+#include "FrameParser.h"
+
+bool FrameParser::feed(uint8_t value) {
+    if (length == 0U) {
+        if (value != HEADER) {
+            hunting = true;
+            return false;
+        }
+        if (hunting) {
+            hunting = false;
+            ++resyncCount;
+        }
+    }
+    buffer[length++] = value;
+    if (length < FRAME_SIZE) {
+        return false;
+    }
+
+    const uint8_t sum = static_cast<uint8_t>(buffer[0] + buffer[1] + buffer[2]);
+    if (sum == buffer[3]) {
+        distance = static_cast<uint16_t>((static_cast<uint16_t>(buffer[1]) << 8) | buffer[2]);
+        length = 0U;
+        ++frameCount;
+        return true;
+    }
+
+    // Start over at the next header inside the bad frame, if there is one
+    ++checksumErrorCount;
+    uint8_t next = 1U;
+    while (next < FRAME_SIZE && buffer[next] != HEADER) {
+        ++next;
+    }
+    for (uint8_t i = next; i < FRAME_SIZE; ++i) {
+        buffer[i - next] = buffer[i];
+    }
+    length = FRAME_SIZE - next;
+    if (length > 0U) {
+        ++resyncCount;
+    } else {
+        hunting = true;
+    }
+    return false;
+}
+
+void FrameParser::reset() {
+    length = 0U;
+    hunting = false;
+}
\ No newline at end of file
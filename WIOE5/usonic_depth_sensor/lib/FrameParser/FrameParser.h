@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Incremental parser for the frames of the ultrasonic sensor
+ *
+ * A frame is 0xFF, the distance in mm (high byte, low byte) and the low
+ * byte of the sum of the first three bytes. Bytes are fed one at a time.
+ * When a checksum fails the parser restarts at the next 0xFF inside the
+ * bad frame, so a real header that arrived in the middle of it isn't lost.
+ * Only depends on the C standard library so it can be built for the host.
+ */
+class FrameParser {
+public:
+    static constexpr uint8_t HEADER = 0xFFU;
+    static constexpr uint8_t FRAME_SIZE = 4U;
+
+    /**
+     * @brief Feed the next received byte
+     * @return true when it completed a valid frame, see distanceMm()
+     */
+    bool feed(uint8_t value);
+
+    /**
+     * @brief Drop a partially received frame, the counters are kept
+     */
+    void reset();
+
+    /**
+     * @brief Distance of the last valid frame in millimetres
+     */
+    uint16_t distanceMm() const { return distance; }
+
+    uint32_t frames() const { return frameCount; }
+    uint32_t checksumErrors() const { return checksumErrorCount; }
+    /**
+     * @brief Number of times bytes were skipped to find the next header
+     */
+    uint32_t resyncs() const { return resyncCount; }
+
+private:
+    uint8_t buffer[FRAME_SIZE] = {};
+    uint8_t length = 0U;
+    bool hunting = false;
+    uint16_t distance = 0U;
+    uint32_t frameCount = 0U;
+    uint32_t checksumErrorCount = 0U;
+    uint32_t resyncCount = 0U;
+};
\ No newline at end of file
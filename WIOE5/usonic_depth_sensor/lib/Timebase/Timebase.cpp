@@ -0,0 +1,27 @@
+#include "Timebase.h"
+
+uint64_t Timebase::update(uint32_t nowMillis) {
+    // The unsigned difference is right across the wrap of the counter
+    awakeMs += static_cast<uint32_t>(nowMillis - lastMillis);
+    lastMillis = nowMillis;
+    return awakeMs + asleepMs;
+}
+
+void Timebase::addSleep(uint32_t sleptMs) {
+    asleepMs += sleptMs;
+}
+
+uint64_t Timebase::calendarMs(uint8_t year, uint8_t month, uint8_t day,
+                              uint8_t hours, uint8_t minutes, uint8_t seconds, uint16_t subMs) {
+    static const uint16_t daysBeforeMonth[] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    if (month < 1U || month > 12U) {
+        month = 1U;
+    }
+    // 2000 is a leap year, (year + 3) / 4 of them come before `year`
+    uint32_t days = year * 365U + (year + 3U) / 4U + daysBeforeMonth[month - 1U] + day - 1U;
+    if ((year % 4U) == 0U && month > 2U) {
+        ++days;
+    }
+    const uint64_t totalSeconds = static_cast<uint64_t>(days) * 86400U + hours * 3600U + minutes * 60U + seconds;
+    return totalSeconds * 1000U + subMs;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief 64-bit uptime from a wrapping millisecond counter and measured sleeps
+ *
+ * millis() wraps after 49 days and stops while the SysTick is suspended for
+ * STOP2. The time slept is measured on the RTC calendar and added with
+ * addSleep(). Only depends on the C standard library so it can be built for
+ * the host.
+ */
+class Timebase {
+public:
+    /**
+     * @brief Account for the counter and return the uptime
+     *
+     * Has to be called at least once per wrap of the counter, which the
+     * firmware does on every wake.
+     * @param nowMillis Current value of millis()
+     * @return Monotonic uptime in milliseconds
+     */
+    uint64_t update(uint32_t nowMillis);
+
+    /**
+     * @brief Add time that passed while the counter was stopped
+     * @param sleptMs Time slept in milliseconds
+     */
+    void addSleep(uint32_t sleptMs);
+
+    /**
+     * @brief Milliseconds since 2000-01-01 of an RTC calendar reading
+     * @param year Years since 2000
+     * @param month 1 to 12
+     * @param day Day of the month, from 1
+     * @param subMs Milliseconds into the second
+     */
+    static uint64_t calendarMs(uint8_t year, uint8_t month, uint8_t day,
+                               uint8_t hours, uint8_t minutes, uint8_t seconds, uint16_t subMs);
+
+private:
+    uint64_t awakeMs = 0U;
+    uint64_t asleepMs = 0U;
+    uint32_t lastMillis = 0U;
+};
\ No newline at end of file
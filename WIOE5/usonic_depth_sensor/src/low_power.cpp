@@ -1,6 +1,8 @@
 #include <Arduino.h>
+#include <Timebase.h>
 
 #include "low_power.h"
+#include "timebase.h"
 
 extern "C" void SystemClock_Config(void);
 
@@ -11,6 +13,16 @@ bool rtcWakeReady = false;
 constexpr uint32_t RTC_ASYNC_PREDIV = 0x7Fu;
 constexpr uint32_t RTC_SYNC_PREDIV = 0x00FFu;
 
+// RTCCLK/16 counts 2048 times per second up to 0xFFFF, ck_spre once per
+// second up to 0x1FFFF with the 17 bit mode
+constexpr uint32_t RTC_FAST_WAKEUP_HZ = 2048U;
+constexpr uint32_t RTC_FAST_WAKEUP_MAX_MS = 0x10000U * 1000U / RTC_FAST_WAKEUP_HZ;
+constexpr uint32_t RTC_SLOW_WAKEUP_MAX_S = 0x20000U;
+// Resolution of the calendar subseconds
+constexpr uint32_t RTC_TICK_MS = 1000U / (RTC_SYNC_PREDIV + 1U) + 1U;
+// Wakeups allowed on top of the planned ones before giving up
+constexpr uint32_t SPARE_WAKEUPS = 4U;
+
 bool ensureRtcWakeupReady() {
     if (rtcWakeReady) {
         return true;
@@ -55,44 +67,97 @@ bool ensureRtcWakeupReady() {
     rtcWakeReady = true;
     return true;
 }
-} // namespace
 
-void goToSleep(uint32_t timeoutMs) {
-    if (timeoutMs == 0U) {
-        return;
-    }
+// The shadow registers of the calendar are stale after STOP2
+void syncCalendar() {
+    __HAL_RTC_WRITEPROTECTION_DISABLE(&rtcWakeHandle);
+    HAL_RTC_WaitForSynchro(&rtcWakeHandle);
+    __HAL_RTC_WRITEPROTECTION_ENABLE(&rtcWakeHandle);
+}
 
-    if (!ensureRtcWakeupReady()) {
-        delay(timeoutMs);
-        return;
-    }
+// Milliseconds since 2000-01-01 on the RTC calendar
+uint64_t calendarMs() {
+    RTC_TimeTypeDef time = {};
+    RTC_DateTypeDef date = {};
+    // The date has to be read after the time to unlock the shadow registers
+    HAL_RTC_GetTime(&rtcWakeHandle, &time, RTC_FORMAT_BIN);
+    HAL_RTC_GetDate(&rtcWakeHandle, &date, RTC_FORMAT_BIN);
 
-    uint32_t wakeSeconds = (timeoutMs + 999U) / 1000U;
-    if (wakeSeconds == 0U) {
-        wakeSeconds = 1U;
-    }
+    const uint32_t subMs = ((time.SecondFraction - time.SubSeconds) * 1000U) / (time.SecondFraction + 1U);
+    return Timebase::calendarMs(date.Year, date.Month, date.Date, time.Hours, time.Minutes, time.Seconds, subMs);
+}
 
-    uint32_t wakeCounter = wakeSeconds - 1U;
-    if (wakeCounter > 0xFFFFU) {
-        wakeCounter = 0xFFFFU;
+// Arms the wakeup timer for at most `remainingMs`, returns the time armed
+uint32_t armWakeup(uint32_t remainingMs) {
+    uint32_t counter;
+    uint32_t clock;
+    uint32_t armedMs;
+    if (remainingMs <= RTC_FAST_WAKEUP_MAX_MS) {
+        counter = (remainingMs * RTC_FAST_WAKEUP_HZ) / 1000U;
+        counter = counter > 0U ? counter - 1U : 0U;
+        clock = RTC_WAKEUPCLOCK_RTCCLK_DIV16;
+        armedMs = ((counter + 1U) * 1000U) / RTC_FAST_WAKEUP_HZ;
+    } else {
+        // Whole seconds, what is left over gets a short period of its own
+        uint32_t seconds = remainingMs / 1000U;
+        if (seconds > RTC_SLOW_WAKEUP_MAX_S) {
+            seconds = RTC_SLOW_WAKEUP_MAX_S;
+        }
+        if (seconds > 0x10000U) {
+            // The 17 bit mode adds 2^16 to the counter
+            counter = seconds - 1U - 0x10000U;
+            clock = RTC_WAKEUPCLOCK_CK_SPRE_17BITS;
+        } else {
+            counter = seconds - 1U;
+            clock = RTC_WAKEUPCLOCK_CK_SPRE_16BITS;
+        }
+        armedMs = seconds * 1000U;
     }
 
     if (HAL_RTCEx_DeactivateWakeUpTimer(&rtcWakeHandle) != HAL_OK) {
-        delay(timeoutMs);
-        return;
+        return 0U;
+    }
+    if (HAL_RTCEx_SetWakeUpTimer_IT(&rtcWakeHandle, counter, clock, 0U) != HAL_OK) {
+        return 0U;
+    }
+    return armedMs;
+}
+} // namespace
+
+uint32_t goToSleep(uint32_t timeoutMs) {
+    if (timeoutMs == 0U) {
+        return 0U;
     }
 
-    if (HAL_RTCEx_SetWakeUpTimer_IT(&rtcWakeHandle, wakeCounter, RTC_WAKEUPCLOCK_CK_SPRE_16BITS, 0U) != HAL_OK) {
+    if (!ensureRtcWakeupReady()) {
         delay(timeoutMs);
-        return;
+        return timeoutMs;
     }
 
+    syncCalendar();
+    const uint64_t startMs = calendarMs();
+    uint32_t sleptMs = 0U;
+    uint32_t wakeupsLeft = timeoutMs / (RTC_SLOW_WAKEUP_MAX_S * 1000U) + 2U + SPARE_WAKEUPS;
+
     Serial.end();
     HAL_SuspendTick();
-    __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
-    HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+    // Between wakeups we stay on the wakeup clock, only the RTC is touched
+    while (sleptMs < timeoutMs && timeoutMs - sleptMs >= RTC_TICK_MS && wakeupsLeft > 0U) {
+        if (armWakeup(timeoutMs - sleptMs) == 0U) {
+            break;
+        }
+        __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
+        HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+        --wakeupsLeft;
+
+        syncCalendar();
+        const uint64_t elapsedMs = calendarMs() - startMs;
+        sleptMs = elapsedMs > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(elapsedMs);
+    }
 
     SystemClock_Config();
     HAL_ResumeTick();
     HAL_RTCEx_DeactivateWakeUpTimer(&rtcWakeHandle);
+    addSleepTime(sleptMs);
+    return sleptMs;
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include <Arduino.h>
+#include <DepthPayload.h>
 #include "low_power.h"
 #include "sensor.h"
 #include "lora.h"
 #include "battery.h"
+#include "timebase.h"
 
 // Telemetry Timing & Sensitivity Settings
 #ifndef WAKE_INTERVAL_MS
@@ -25,9 +27,12 @@
 #define LOW_VOLTAGE_RECOVERY_HYSTERESIS_MV 100U
 #endif
 
+// Set to 5 (DepthPayload::VERSION_PACKED) for a 4 byte payload once the backend can decode it
 #ifndef PAYLOAD_VERSION
 #define PAYLOAD_VERSION 3
 #endif
+static_assert(PAYLOAD_VERSION == DepthPayload::VERSION_FIXED || PAYLOAD_VERSION == DepthPayload::VERSION_PACKED,
+              "PAYLOAD_VERSION must be a single reading format of DepthPayload");
 
 #ifndef DISABLE_SLEEP_FOR_CALIBRATION
 #define DISABLE_SLEEP_FOR_CALIBRATION 0
@@ -35,9 +40,10 @@
 
 // Globals (Wiped on battery disconnect or physical RST press)
 float lastSentDistance = -1.0;
-uint32_t lastSentMillis = 0;
+uint64_t lastSentUptimeMs = 0;
 bool lowVoltageAlertLatched = false;
 uint16_t wakeBootCount = 0;
+uint32_t lastSleepMs = 0;
 
 namespace {
 bool wakeLedReady = false;
@@ -45,11 +51,12 @@ bool wakeLedReady = false;
 constexpr uint32_t SENSOR_BOOT_PROBE_TIMEOUT_MS = 1000U;
 constexpr uint32_t LED_ERROR_BLINK_MS = 100U;
 
-void sleepOrCalibrationWait(uint32_t sleepMs) {
+uint32_t sleepOrCalibrationWait(uint32_t sleepMs) {
 #if DISABLE_SLEEP_FOR_CALIBRATION
     delay(sleepMs);
+    return sleepMs;
 #else
-    goToSleep(sleepMs);
+    return goToSleep(sleepMs);
 #endif
 }
 
@@ -83,16 +90,15 @@ void signalFatalSensorError() {
 bool loraTransmitWithRetries(float distance, uint16_t voltageMv, uint16_t bootCount) {
     const uint16_t rangeMm = static_cast<uint16_t>((distance * 1000.0f) + 0.5f);
 
-    uint8_t payload[7];
-    payload[0] = PAYLOAD_VERSION;
-    payload[1] = highByte(rangeMm);
-    payload[2] = lowByte(rangeMm);
-    payload[3] = highByte(voltageMv);
-    payload[4] = lowByte(voltageMv);
-    payload[5] = highByte(bootCount);
-    payload[6] = lowByte(bootCount);
+    const DepthReading reading = {rangeMm, voltageMv, bootCount};
+    uint8_t payload[DepthPayload::FIXED_SIZE];
+    const size_t payloadLen = DepthPayload::encode(PAYLOAD_VERSION, reading, payload, sizeof(payload));
+    if (payloadLen == 0) {
+        Serial.println("[LoRaWAN] Payload could not be encoded; not sending.");
+        return false;
+    }
 
-    const bool sent = loraTransmit(payload, sizeof(payload));
+    const bool sent = loraTransmit(payload, payloadLen);
     if (!sent) {
         Serial.println("[LoRaWAN] Send failed; retries exhausted or join not available in this cycle.");
     }
@@ -131,6 +137,9 @@ void loop() {
     Serial.println("\n--- Core Wake Cycle ---");
     Serial.print("[Boot] Wake count (volatile): ");
     Serial.println(wakeBootCount);
+    Serial.print("[Power] Slept: ");
+    Serial.print(lastSleepMs);
+    Serial.println(" ms");
 
     const uint16_t batteryMv = measureBatteryVoltageMv();
     Serial.print("[Power] Measured voltage: ");
@@ -163,10 +172,11 @@ void loop() {
         Serial.print(currentDistance, 3);
         Serial.println(" m");
 
-        uint32_t now = millis();
+        // millis() stops in STOP2, the heartbeat needs the time slept as well
+        uint64_t now = uptimeMs();
         bool firstRun = (lastSentDistance < 0);
         float delta = abs(currentDistance - lastSentDistance);
-        bool heartbeatDue = !firstRun && ((uint32_t)(now - lastSentMillis) >= HEARTBEAT_INTERVAL_MS);
+        bool heartbeatDue = !firstRun && ((now - lastSentUptimeMs) >= HEARTBEAT_INTERVAL_MS);
         bool shouldSend = firstRun ||
                   (delta >= SIGNIFICANT_CHANGE_THRESHOLD) ||
                   heartbeatDue ||
@@ -196,7 +206,7 @@ void loop() {
             const bool sent = loraTransmitWithRetries(currentDistance, batteryMv, wakeBootCount);
             if (sent) {
                 lastSentDistance = currentDistance;
-                lastSentMillis = now;
+                lastSentUptimeMs = now;
                 if (lowVoltageTrigger) {
                     lowVoltageAlertLatched = true;
                 }
@@ -211,5 +221,5 @@ void loop() {
     
     // We did our job, we can go back to sleep
     setWakeLedState(false);
-    sleepOrCalibrationWait(WAKE_INTERVAL_MS);
+    lastSleepMs = sleepOrCalibrationWait(WAKE_INTERVAL_MS);
 }
\ No newline at end of file
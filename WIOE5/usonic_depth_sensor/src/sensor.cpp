@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include <FrameParser.h>
 #include <HardwareSerial.h>
 #include "sensor.h"
 
@@ -10,35 +11,38 @@
 HardwareSerial sensorSerial(PC0, PC1);
 
 namespace {
+FrameParser frameParser;
+
+// The core's RX interrupt fills the Serial ring buffer, so we can sleep
+// between bytes. Any interrupt wakes us, at the latest the 1 ms SysTick,
+// which also bounds the wait if a byte slips in just before the WFI.
+void waitForInterrupt() {
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+}
+
 float readSensorDistanceInternal(uint32_t timeoutMs) {
-    uint8_t buffer[4];
-    uint8_t bufferIndex = 0;
     uint32_t startTime = millis();
 
     // Clear anything that arrived while waiting
     while (sensorSerial.available()) {
         sensorSerial.read();
     }
+    frameParser.reset();
 
     while ((millis() - startTime) < timeoutMs) {
-        if (sensorSerial.available()) {
-            uint8_t incomingByte = sensorSerial.read();
-            if (bufferIndex == 0 && incomingByte != 0xFF) {
-                continue;
-            }
-            buffer[bufferIndex++] = incomingByte;
-
-            if (bufferIndex == 4) {
-                uint8_t calculatedSum = (buffer[0] + buffer[1] + buffer[2]) & 0xFF;
-                if (calculatedSum == buffer[3]) {
-                    uint16_t distanceMm = (static_cast<uint16_t>(buffer[1]) << 8) | buffer[2];
-                    return distanceMm / 1000.0f; // Conversion to meters
-                }
-                bufferIndex = 0;
-            }
+        if (!sensorSerial.available()) {
+            waitForInterrupt();
+            continue;
+        }
+        if (frameParser.feed(static_cast<uint8_t>(sensorSerial.read()))) {
+            return frameParser.distanceMm() / 1000.0f; // Conversion to meters
         }
     }
 
+    Serial.print("[Sensor] No valid frame. Checksum errors: ");
+    Serial.print(frameParser.checksumErrors());
+    Serial.print(", resyncs: ");
+    Serial.println(frameParser.resyncs());
     return -1.0f; // Return error code on timeout
 }
 } // namespace
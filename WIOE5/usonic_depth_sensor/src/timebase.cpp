@@ -0,0 +1,16 @@
+#include <Arduino.h>
+#include <Timebase.h>
+
+#include "timebase.h"
+
+namespace {
+Timebase timebase;
+} // namespace
+
+uint64_t uptimeMs() {
+    return timebase.update(millis());
+}
+
+void addSleepTime(uint32_t sleptMs) {
+    timebase.addSleep(sleptMs);
+}
\ No newline at end of file
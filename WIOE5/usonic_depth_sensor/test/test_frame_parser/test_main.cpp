@@ -0,0 +1,231 @@
+// Host tests for FrameParser, run with: pio test -e native
+
+#include <FrameParser.h>
+#include <stdio.h>
+#include <time.h>
+#include <unity.h>
+
+#include <vector>
+
+namespace {
+
+uint32_t rngState;
+
+uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+void appendFrame(std::vector<uint8_t> &stream, uint16_t distanceMm) {
+    const uint8_t high = distanceMm >> 8;
+    const uint8_t low = distanceMm & 0xFF;
+    stream.push_back(FrameParser::HEADER);
+    stream.push_back(high);
+    stream.push_back(low);
+    stream.push_back(static_cast<uint8_t>(FrameParser::HEADER + high + low));
+}
+
+// Distances the sensor can report, their high byte is never a header
+uint16_t randomDistance() {
+    return 280 + nextRandom() % 7000;
+}
+
+std::vector<uint16_t> feedAll(FrameParser &parser, const std::vector<uint8_t> &stream) {
+    std::vector<uint16_t> distances;
+    for (uint8_t value : stream) {
+        if (parser.feed(value)) {
+            distances.push_back(parser.distanceMm());
+        }
+    }
+    return distances;
+}
+
+}  // namespace
+
+void setUp() {
+    rngState = 0x9E3779B9U;
+}
+
+void tearDown() {
+}
+
+void test_valid_frames() {
+    FrameParser parser;
+    std::vector<uint8_t> stream;
+    appendFrame(stream, 500);
+    appendFrame(stream, 0x1234);
+    std::vector<uint16_t> distances = feedAll(parser, stream);
+    TEST_ASSERT_EQUAL(2, distances.size());
+    TEST_ASSERT_EQUAL_UINT16(500, distances[0]);
+    TEST_ASSERT_EQUAL_UINT16(0x1234, distances[1]);
+    TEST_ASSERT_EQUAL_UINT32(2, parser.frames());
+    TEST_ASSERT_EQUAL_UINT32(0, parser.checksumErrors());
+    TEST_ASSERT_EQUAL_UINT32(0, parser.resyncs());
+}
+
+void test_garbage_before_header() {
+    FrameParser parser;
+    std::vector<uint8_t> stream = {0x12, 0x34, 0x56};
+    appendFrame(stream, 1000);
+    std::vector<uint16_t> distances = feedAll(parser, stream);
+    TEST_ASSERT_EQUAL(1, distances.size());
+    TEST_ASSERT_EQUAL_UINT16(1000, distances[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, parser.checksumErrors());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.resyncs());
+}
+
+void test_header_inside_bad_frame() {
+    // The frame that starts at the first 0xFF is cut short by the real one
+    FrameParser parser;
+    std::vector<uint8_t> stream = {0xFF, 0x02};
+    appendFrame(stream, 1000);
+    std::vector<uint16_t> distances = feedAll(parser, stream);
+    TEST_ASSERT_EQUAL(1, distances.size());
+    TEST_ASSERT_EQUAL_UINT16(1000, distances[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.checksumErrors());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.resyncs());
+}
+
+void test_bad_frame_without_header() {
+    FrameParser parser;
+    std::vector<uint8_t> stream = {0xFF, 0x01, 0x02, 0x03, 0x04};
+    appendFrame(stream, 300);
+    std::vector<uint16_t> distances = feedAll(parser, stream);
+    TEST_ASSERT_EQUAL(1, distances.size());
+    TEST_ASSERT_EQUAL_UINT16(300, distances[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.checksumErrors());
+    // Hunting after the bad frame counts once, when the header turns up
+    TEST_ASSERT_EQUAL_UINT32(1, parser.resyncs());
+}
+
+void test_reset_drops_partial_frame() {
+    FrameParser parser;
+    parser.feed(0xFF);
+    parser.feed(0x01);
+    parser.reset();
+    std::vector<uint8_t> stream;
+    appendFrame(stream, 700);
+    std::vector<uint16_t> distances = feedAll(parser, stream);
+    TEST_ASSERT_EQUAL(1, distances.size());
+    TEST_ASSERT_EQUAL_UINT16(700, distances[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, parser.checksumErrors());
+}
+
+void test_split_stream() {
+    // Bytes come out of the UART in chunks of any size
+    std::vector<uint8_t> stream = {0x55, 0xFF};
+    std::vector<uint16_t> expected;
+    for (int i = 0; i < 200; i++) {
+        expected.push_back(randomDistance());
+        appendFrame(stream, expected.back());
+    }
+    for (int run = 0; run < 100; run++) {
+        FrameParser parser;
+        std::vector<uint16_t> distances;
+        size_t pos = 0;
+        while (pos < stream.size()) {
+            std::vector<uint8_t> chunk;
+            size_t len = 1 + nextRandom() % 9;
+            for (; len > 0 && pos < stream.size(); len--) {
+                chunk.push_back(stream[pos++]);
+            }
+            std::vector<uint16_t> part = feedAll(parser, chunk);
+            distances.insert(distances.end(), part.begin(), part.end());
+        }
+        TEST_ASSERT_EQUAL(expected.size(), distances.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            TEST_ASSERT_EQUAL_UINT16(expected[i], distances[i]);
+        }
+    }
+}
+
+void test_fuzz_corrupted_frame() {
+    // Corrupting one byte of frame k may lose frames k and k+1, but the
+    // parser has to be locked again from frame k+2 on
+    const size_t frameCount = 8;
+    for (int run = 0; run < 100000; run++) {
+        std::vector<uint16_t> sent;
+        std::vector<uint8_t> stream;
+        for (size_t i = 0; i < frameCount; i++) {
+            sent.push_back(randomDistance());
+            appendFrame(stream, sent.back());
+        }
+        const size_t bad = nextRandom() % (frameCount - 2);
+        const size_t pos = bad * FrameParser::FRAME_SIZE + nextRandom() % FrameParser::FRAME_SIZE;
+        stream[pos] ^= 1 + nextRandom() % 0xFF;
+
+        FrameParser parser;
+        std::vector<uint16_t> distances = feedAll(parser, stream);
+        TEST_ASSERT_GREATER_OR_EQUAL(frameCount - 2, distances.size());
+        TEST_ASSERT_LESS_OR_EQUAL(frameCount, distances.size());
+        for (size_t i = 0; i < bad; i++) {
+            TEST_ASSERT_EQUAL_UINT16(sent[i], distances[i]);
+        }
+        const size_t tail = frameCount - bad - 2;
+        for (size_t i = 0; i < tail; i++) {
+            TEST_ASSERT_EQUAL_UINT16(sent[frameCount - 1 - i], distances[distances.size() - 1 - i]);
+        }
+        if (distances.size() < frameCount) {
+            TEST_ASSERT_GREATER_THAN(0, parser.checksumErrors() + parser.resyncs());
+        }
+    }
+}
+
+void test_fuzz_random_bytes() {
+    // Every frame reported has to be a valid frame in the stream
+    FrameParser parser;
+    uint8_t window[FrameParser::FRAME_SIZE] = {};
+    uint32_t reported = 0;
+    for (int i = 0; i < 4000000; i++) {
+        uint8_t value = nextRandom() % 8 == 0 ? FrameParser::HEADER : static_cast<uint8_t>(nextRandom());
+        for (uint8_t j = 1; j < FrameParser::FRAME_SIZE; j++) {
+            window[j - 1] = window[j];
+        }
+        window[FrameParser::FRAME_SIZE - 1] = value;
+        if (parser.feed(value)) {
+            reported++;
+            TEST_ASSERT_EQUAL_HEX8(FrameParser::HEADER, window[0]);
+            TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(window[0] + window[1] + window[2]), window[3]);
+            TEST_ASSERT_EQUAL_UINT16((window[1] << 8) | window[2], parser.distanceMm());
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(reported, parser.frames());
+    TEST_ASSERT_GREATER_THAN(0, parser.checksumErrors());
+    TEST_ASSERT_GREATER_THAN(0, parser.resyncs());
+}
+
+void test_throughput() {
+    std::vector<uint8_t> stream;
+    for (int i = 0; i < 1 << 18; i++) {
+        appendFrame(stream, randomDistance());
+    }
+    const int passes = 16;
+    FrameParser parser;
+    clock_t start = clock();
+    for (int pass = 0; pass < passes; pass++) {
+        for (uint8_t value : stream) {
+            parser.feed(value);
+        }
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.1f MB/s", passes * stream.size() / seconds / 1e6);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(passes * (stream.size() / FrameParser::FRAME_SIZE), parser.frames());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_frames);
+    RUN_TEST(test_garbage_before_header);
+    RUN_TEST(test_header_inside_bad_frame);
+    RUN_TEST(test_bad_frame_without_header);
+    RUN_TEST(test_reset_drops_partial_frame);
+    RUN_TEST(test_split_stream);
+    RUN_TEST(test_fuzz_corrupted_frame);
+    RUN_TEST(test_fuzz_random_bytes);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+// Host tests for Timebase, run with: pio test -e native
+
+#include <Timebase.h>
+#include <unity.h>
+
+namespace {
+
+// RTC calendar of the STM32WL, advanced field by field the way the
+// hardware does it, with 256 subsecond ticks per second
+struct SimulatedRtc {
+    uint8_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hours;
+    uint8_t minutes;
+    uint8_t seconds;
+    uint16_t ticks;
+
+    uint8_t daysInMonth() const {
+        static const uint8_t days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        return (month == 2U && year % 4U == 0U) ? 29U : days[month - 1U];
+    }
+
+    void tick() {
+        if (++ticks < 256U) {
+            return;
+        }
+        ticks = 0U;
+        nextSecond();
+    }
+
+    void advance(uint32_t count) {
+        for (; count > 0U && ticks != 0U; count--) {
+            tick();
+        }
+        for (; count >= 256U; count -= 256U) {
+            nextSecond();
+        }
+        for (; count > 0U; count--) {
+            tick();
+        }
+    }
+
+    void nextSecond() {
+        if (++seconds < 60U) {
+            return;
+        }
+        seconds = 0U;
+        if (++minutes < 60U) {
+            return;
+        }
+        minutes = 0U;
+        if (++hours < 24U) {
+            return;
+        }
+        hours = 0U;
+        if (++day <= daysInMonth()) {
+            return;
+        }
+        day = 1U;
+        if (++month <= 12U) {
+            return;
+        }
+        month = 1U;
+        ++year;
+    }
+
+    // What calendarMs() in low_power.cpp computes from the registers
+    uint64_t readMs() const {
+        return Timebase::calendarMs(year, month, day, hours, minutes, seconds, (ticks * 1000U) / 256U);
+    }
+};
+
+uint32_t rngState;
+
+uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+}  // namespace
+
+void setUp() {
+    rngState = 0x2545F491U;
+}
+
+void tearDown() {
+}
+
+void test_counts_from_zero() {
+    Timebase timebase;
+    TEST_ASSERT_EQUAL_UINT64(0, timebase.update(0));
+    TEST_ASSERT_EQUAL_UINT64(1234, timebase.update(1234));
+    TEST_ASSERT_EQUAL_UINT64(1234, timebase.update(1234));
+}
+
+void test_millis_rollover() {
+    Timebase timebase;
+    timebase.update(0);
+    TEST_ASSERT_EQUAL_UINT64(0xFFFFFFF0ULL, timebase.update(0xFFFFFFF0U));
+    TEST_ASSERT_EQUAL_UINT64(0x100000010ULL, timebase.update(0x10U));
+    // And again on the next wrap
+    TEST_ASSERT_EQUAL_UINT64(0x1FFFFFFF0ULL, timebase.update(0xFFFFFFF0U));
+    TEST_ASSERT_EQUAL_UINT64(0x200000010ULL, timebase.update(0x10U));
+}
+
+void test_sleep_is_added() {
+    Timebase timebase;
+    timebase.update(1000);
+    timebase.addSleep(0xFFFFFFFFU);
+    timebase.addSleep(0xFFFFFFFFU);
+    // millis() didn't move while asleep
+    TEST_ASSERT_EQUAL_UINT64(1000 + 2 * 0xFFFFFFFFULL + 5, timebase.update(1005));
+}
+
+void test_calendar_boundaries() {
+    TEST_ASSERT_EQUAL_UINT64(0, Timebase::calendarMs(0, 1, 1, 0, 0, 0, 0));
+    // 2000 and 2004 are leap years, 2001 isn't
+    TEST_ASSERT_EQUAL_UINT64(60ULL * 86400000ULL, Timebase::calendarMs(0, 3, 1, 0, 0, 0, 0));
+    TEST_ASSERT_EQUAL_UINT64(366ULL * 86400000ULL, Timebase::calendarMs(1, 1, 1, 0, 0, 0, 0));
+    TEST_ASSERT_EQUAL_UINT64((366ULL + 59) * 86400000ULL, Timebase::calendarMs(1, 3, 1, 0, 0, 0, 0));
+    TEST_ASSERT_EQUAL_UINT64((4 * 365ULL + 1 + 59) * 86400000ULL, Timebase::calendarMs(4, 2, 29, 0, 0, 0, 0));
+    TEST_ASSERT_EQUAL_UINT64(86400000ULL - 1, Timebase::calendarMs(0, 1, 1, 23, 59, 59, 999));
+}
+
+void test_calendar_follows_rtc() {
+    // One tick at a time across a leap day and a year end
+    SimulatedRtc rtc = {3, 12, 31, 23, 59, 0, 0};
+    const uint64_t startMs = rtc.readMs();
+    for (uint32_t tick = 1; tick <= 256U * 120U; tick++) {
+        rtc.tick();
+        TEST_ASSERT_EQUAL_UINT64(startMs + (tick * 1000ULL) / 256U, rtc.readMs());
+    }
+    TEST_ASSERT_EQUAL_UINT8(4, rtc.year);
+    rtc = {4, 2, 28, 23, 59, 59, 255};
+    const uint64_t beforeMs = rtc.readMs();
+    rtc.tick();
+    TEST_ASSERT_EQUAL_UINT8(29, rtc.day);
+    TEST_ASSERT_EQUAL_UINT64(beforeMs + 4, rtc.readMs());
+}
+
+void test_wake_sleep_cycles() {
+    // Wakes of a few seconds in between STOP2 sleeps measured on the RTC,
+    // starting just before the millis() wrap, through the 2024 leap day and
+    // into 2025
+    SimulatedRtc rtc = {23, 12, 30, 22, 0, 0, 0};
+    Timebase timebase;
+    uint32_t millisCounter = 0xFFFF0000U;
+    // Everything before is time awake since boot
+    uint64_t trueMs = timebase.update(millisCounter);
+
+    for (int wake = 0; wake < 5000; wake++) {
+        const uint32_t awakeMs = 100U + nextRandom() % 5000U;
+        millisCounter += awakeMs;
+        trueMs += awakeMs;
+        rtc.advance(awakeMs * 256U / 1000U);
+        // The sleep is a whole number of RTC ticks, like a wakeup would be
+        const uint32_t sleepTicks = 256U * (60U + nextRandom() % 14400U) + nextRandom() % 256U;
+        const uint64_t startMs = rtc.readMs();
+        rtc.advance(sleepTicks);
+        const uint32_t sleptMs = static_cast<uint32_t>(rtc.readMs() - startMs);
+        timebase.addSleep(sleptMs);
+        trueMs += sleepTicks * 1000ULL / 256U;
+
+        const uint64_t uptime = timebase.update(millisCounter);
+        // Each measurement is off by less than a ms, the error can't grow
+        // by more than that per cycle
+        TEST_ASSERT_UINT64_WITHIN(wake + 1U, trueMs, uptime);
+    }
+    TEST_ASSERT_EQUAL_UINT8(25, rtc.year);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_counts_from_zero);
+    RUN_TEST(test_millis_rollover);
+    RUN_TEST(test_sleep_is_added);
+    RUN_TEST(test_calendar_boundaries);
+    RUN_TEST(test_calendar_follows_rtc);
+    RUN_TEST(test_wake_sleep_cycles);
+    return UNITY_END();
+}
@@ -0,0 +1,291 @@
+
+#include "DepthPayload.h"
+
+namespace {
+
+const uint8_t PACKED_TAG = 0x5;  // 0b101
+const uint16_t PACKED_VOLTAGE_BASE = 2000;
+const uint16_t PACKED_VOLTAGE_STEP = 40;
+const uint8_t PACKED_VOLTAGE_MAX = 0x3f;
+
+class BitWriter {
+   public:
+    BitWriter(uint8_t *buf, size_t maxLen) : buf(buf), maxBits(maxLen * 8), bits(0) {}
+
+    bool put(uint32_t value, uint8_t cnt) {
+        if (bits + cnt > maxBits) {
+            return false;
+        }
+        while (cnt > 0) {
+            cnt--;
+            size_t byte = bits / 8;
+            uint8_t mask = 0x80 >> (bits % 8);
+            if (bits % 8 == 0) {
+                buf[byte] = 0;
+            }
+            if ((value >> cnt) & 1) {
+                buf[byte] |= mask;
+            }
+            bits++;
+        }
+        return true;
+    }
+
+    size_t length() const { return (bits + 7) / 8; }
+
+   private:
+    uint8_t *buf;
+    size_t maxBits;
+    size_t bits;
+};
+
+class BitReader {
+   public:
+    BitReader(const uint8_t *buf, size_t len) : buf(buf), maxBits(len * 8), bits(0) {}
+
+    bool get(uint8_t cnt, uint32_t *value) {
+        if (bits + cnt > maxBits) {
+            return false;
+        }
+        uint32_t v = 0;
+        while (cnt > 0) {
+            cnt--;
+            v = (v << 1) | ((buf[bits / 8] >> (7 - bits % 8)) & 1);
+            bits++;
+        }
+        *value = v;
+        return true;
+    }
+
+    // True if the rest of the buffer is just the zero padding of the last byte
+    bool atEnd() const {
+        if ((bits + 7) / 8 != maxBits / 8) {
+            return false;
+        }
+        uint8_t padding = (8 - bits % 8) % 8;
+        return padding == 0 || (buf[bits / 8] & ((1 << padding) - 1)) == 0;
+    }
+
+   private:
+    const uint8_t *buf;
+    size_t maxBits;
+    size_t bits;
+};
+
+// Writes a value with a one bit length prefix, short if it fits in `shortBits`
+bool putPrefixed(BitWriter &writer, uint16_t value, uint8_t shortBits) {
+    if (value < (1u << shortBits)) {
+        return writer.put(0, 1) && writer.put(value, shortBits);
+    }
+    return writer.put(1, 1) && writer.put(value, 16);
+}
+
+bool getPrefixed(BitReader &reader, uint8_t shortBits, uint16_t *value) {
+    uint32_t prefix, v;
+    if (!reader.get(1, &prefix) || !reader.get(prefix ? 16 : shortBits, &v)) {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+uint8_t voltageToSteps(uint16_t voltage) {
+    if (voltage == 0) {
+        return 0;
+    }
+    if (voltage <= PACKED_VOLTAGE_BASE + PACKED_VOLTAGE_STEP) {
+        return 1;
+    }
+    uint32_t steps = (voltage - PACKED_VOLTAGE_BASE + PACKED_VOLTAGE_STEP / 2) / PACKED_VOLTAGE_STEP;
+    return steps > PACKED_VOLTAGE_MAX ? PACKED_VOLTAGE_MAX : steps;
+}
+
+uint16_t stepsToVoltage(uint8_t steps) {
+    return steps ? PACKED_VOLTAGE_BASE + steps * PACKED_VOLTAGE_STEP : 0;
+}
+
+void putUInt16(uint8_t *buf, uint16_t value) {
+    buf[0] = value >> 8;
+    buf[1] = value & 0xff;
+}
+
+uint16_t getUInt16(const uint8_t *buf) {
+    return (buf[0] << 8) | buf[1];
+}
+
+// Writes `value` as a little-endian base-128 varint, returns the number of bytes used
+size_t putVarint(uint8_t *buf, size_t maxLen, uint32_t value) {
+    size_t len = 0;
+    while (len < maxLen) {
+        uint8_t b = value & 0x7f;
+        value >>= 7;
+        buf[len++] = value ? (b | 0x80) : b;
+        if (!value) {
+            return len;
+        }
+    }
+    return 0;
+}
+
+// Reads a varint at `*pos`, advancing it. Returns false on a truncated varint.
+bool getVarint(const uint8_t *buf, size_t len, size_t *pos, uint32_t *value) {
+    uint32_t v = 0;
+    for (uint8_t shift = 0; shift < 32 && *pos < len; shift += 7) {
+        uint8_t b = buf[(*pos)++];
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+uint8_t decodeFixed(const uint8_t *buf, size_t len, DepthReading *readings) {
+    if (len != DepthPayload::FIXED_SIZE) {
+        return 0;
+    }
+    readings[0].range = getUInt16(buf + 1);
+    readings[0].voltage = getUInt16(buf + 3);
+    readings[0].bootCount = getUInt16(buf + 5);
+    return 1;
+}
+
+uint8_t decodePacked(const uint8_t *buf, size_t len, DepthReading *readings) {
+    BitReader reader(buf, len);
+    uint32_t tag, steps;
+    DepthReading reading;
+    if (!reader.get(3, &tag) || tag != PACKED_TAG ||
+        !getPrefixed(reader, 11, &reading.range) ||
+        !reader.get(6, &steps) ||
+        !getPrefixed(reader, 10, &reading.bootCount) ||
+        !reader.atEnd()) {
+        return 0;
+    }
+    reading.voltage = stepsToVoltage(steps);
+    readings[0] = reading;
+    return 1;
+}
+
+uint8_t decodeBatch(const uint8_t *buf, size_t len, DepthReading *readings, uint8_t maxReadings) {
+    if (len < 8 || buf[1] == 0 || buf[1] > maxReadings) {
+        return 0;
+    }
+    uint8_t cnt = buf[1];
+    readings[0].bootCount = getUInt16(buf + 2);
+    readings[0].range = getUInt16(buf + 4);
+    readings[0].voltage = getUInt16(buf + 6);
+    size_t pos = 8;
+    for (uint8_t i = 1; i < cnt; i++) {
+        uint32_t bootDelta, rangeDelta, voltageDelta;
+        if (!getVarint(buf, len, &pos, &bootDelta) ||
+            !getVarint(buf, len, &pos, &rangeDelta) ||
+            !getVarint(buf, len, &pos, &voltageDelta)) {
+            return 0;
+        }
+        readings[i].bootCount = readings[i - 1].bootCount + bootDelta;
+        readings[i].range = readings[i - 1].range + unzigzag(rangeDelta);
+        readings[i].voltage = readings[i - 1].voltage + unzigzag(voltageDelta);
+    }
+    return pos == len ? cnt : 0;
+}
+
+}  // namespace
+
+namespace DepthPayload {
+
+size_t encode(uint8_t version, const DepthReading &reading, uint8_t *buf, size_t maxLen) {
+    switch (version) {
+        case VERSION_FIXED:
+            return encodeFixed(reading, buf, maxLen);
+        case VERSION_PACKED:
+            return encodePacked(reading, buf, maxLen);
+        default:
+            return 0;
+    }
+}
+
+size_t encodeFixed(const DepthReading &reading, uint8_t *buf, size_t maxLen) {
+    if (maxLen < FIXED_SIZE) {
+        return 0;
+    }
+    buf[0] = VERSION_FIXED;
+    putUInt16(buf + 1, reading.range);
+    putUInt16(buf + 3, reading.voltage);
+    putUInt16(buf + 5, reading.bootCount);
+    return FIXED_SIZE;
+}
+
+size_t encodePacked(const DepthReading &reading, uint8_t *buf, size_t maxLen) {
+    BitWriter writer(buf, maxLen);
+    if (!writer.put(PACKED_TAG, 3) ||
+        !putPrefixed(writer, reading.range, 11) ||
+        !writer.put(voltageToSteps(reading.voltage), 6) ||
+        !putPrefixed(writer, reading.bootCount, 10)) {
+        return 0;
+    }
+    return writer.length();
+}
+
+size_t encodeBatch(const DepthReading *readings, uint8_t cnt, uint8_t *buf, size_t maxLen, uint8_t *used) {
+    *used = 0;
+    if (cnt == 0 || maxLen < 8) {
+        return 0;
+    }
+    buf[0] = VERSION_BATCH;
+    putUInt16(buf + 2, readings[0].bootCount);
+    putUInt16(buf + 4, readings[0].range);
+    putUInt16(buf + 6, readings[0].voltage);
+    size_t len = 8;
+    uint8_t i = 1;
+    for (; i < cnt; i++) {
+        const DepthReading &prev = readings[i - 1];
+        const DepthReading &cur = readings[i];
+        uint8_t sample[9];
+        size_t bootLen = putVarint(sample, sizeof(sample), (uint16_t)(cur.bootCount - prev.bootCount));
+        size_t rangeLen = putVarint(sample + bootLen, sizeof(sample) - bootLen, zigzag((int32_t)cur.range - prev.range));
+        size_t voltageLen = putVarint(sample + bootLen + rangeLen, sizeof(sample) - bootLen - rangeLen, zigzag((int32_t)cur.voltage - prev.voltage));
+        size_t sampleLen = bootLen + rangeLen + voltageLen;
+        if (len + sampleLen > maxLen) {
+            // The rest will have to go out with the next payload
+            break;
+        }
+        for (size_t j = 0; j < sampleLen; j++) {
+            buf[len++] = sample[j];
+        }
+    }
+    buf[1] = i;
+    *used = i;
+    return len;
+}
+
+uint8_t decode(const uint8_t *buf, size_t len, DepthReading *readings, uint8_t maxReadings) {
+    if (len == 0 || maxReadings == 0) {
+        return 0;
+    }
+    if ((buf[0] >> 5) == PACKED_TAG) {
+        return decodePacked(buf, len, readings);
+    }
+    switch (buf[0]) {
+        case VERSION_FIXED:
+            return decodeFixed(buf, len, readings);
+        case VERSION_BATCH:
+            return decodeBatch(buf, len, readings, maxReadings);
+        default:
+            return 0;
+    }
+}
+
+uint16_t packedVoltage(uint16_t voltage) {
+    return stepsToVoltage(voltageToSteps(voltage));
+}
+
+}  // namespace DepthPayload
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Uplink payload codec shared by the depth sensor projects. It only
+// depends on the C standard library so it can be built for the host too.
+
+struct DepthReading {
+    uint16_t range;      // Measured range in mm
+    uint16_t voltage;    // Battery voltage in mV, 0 if unknown
+    uint16_t bootCount;  // Wake counter of the device
+};
+
+namespace DepthPayload {
+
+// Fixed 7 byte format: version, range, voltage, boot count (big-endian)
+const uint8_t VERSION_FIXED = 3;
+// Multiple readings, delta encoded, see encodeBatch()
+const uint8_t VERSION_BATCH = 4;
+// Bit-packed single reading, see encodePacked()
+const uint8_t VERSION_PACKED = 5;
+
+const size_t FIXED_SIZE = 7;
+const size_t MAX_PACKED_SIZE = 7;
+// Largest payload at the lowest EU868 data rate
+const size_t MAX_SIZE = 51;
+
+// Encodes a single reading using the given format version (VERSION_FIXED
+// or VERSION_PACKED). Returns the payload length or 0 on failure.
+size_t encode(uint8_t version, const DepthReading &reading, uint8_t *buf, size_t maxLen);
+
+size_t encodeFixed(const DepthReading &reading, uint8_t *buf, size_t maxLen);
+
+// Bit-packed format, fields are written MSB first:
+//   3 bits   version (0b101), so the first byte is always 0xA0-0xBF and
+//            never mistaken for one of the byte-aligned formats
+//   1+11/16  range in mm: a 0 bit and 11 bits, or a 1 bit and 16 bits
+//   6 bits   voltage in 40 mV steps above 2000 mV (0 = unknown)
+//   1+10/16  boot count: a 0 bit and 10 bits, or a 1 bit and 16 bits
+// The last byte is padded with zero bits. Ranges below 2048 mm and boot
+// counts below 1024 result in a 4 byte payload.
+size_t encodePacked(const DepthReading &reading, uint8_t *buf, size_t maxLen);
+
+// Batch format (all values big-endian):
+//   [0]    VERSION_BATCH
+//   [1]    number of readings
+//   [2-3]  boot count of the oldest reading
+//   [4-5]  range of the oldest reading
+//   [6-7]  voltage of the oldest reading
+// followed by three varints for each next reading: the boot count delta,
+// and the zigzag encoded range and voltage deltas to the previous reading.
+// Returns the payload length and sets `used` to the number of readings
+// that fit in the payload, oldest first.
+size_t encodeBatch(const DepthReading *readings, uint8_t cnt, uint8_t *buf, size_t maxLen, uint8_t *used);
+
+// Decodes a payload of any of the versions above. Returns the number of
+// readings stored in `readings`, or 0 if the payload is invalid.
+uint8_t decode(const uint8_t *buf, size_t len, DepthReading *readings, uint8_t maxReadings);
+
+// Voltage as it comes out of the packed format, for comparing round trips
+uint16_t packedVoltage(uint16_t voltage);
+
+}  // namespace DepthPayload
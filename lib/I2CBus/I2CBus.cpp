@@ -0,0 +1,149 @@
+#include "I2CBus.h"
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
+I2CBus::I2CBus(TwoWire &wire) : wire(wire), deviceCount(0), clock(0), started(false), mutex(NULL) {
+}
+
+bool I2CBus::add(uint8_t address, uint32_t clock, const char *name) {
+    if (started || deviceCount >= MAX_DEVICES || find(address)) {
+        return false;
+    }
+    devices[deviceCount++] = {address, clock < MAX_CLOCK ? clock : MAX_CLOCK, name, 0, 0, 0};
+    return true;
+}
+
+bool I2CBus::begin(int sda, int scl) {
+    if (started) {
+        return true;
+    }
+    if (!wire.begin(sda, scl)) {
+        return false;
+    }
+    clock = 0;
+#if defined(ESP_PLATFORM)
+    mutex = xSemaphoreCreateRecursiveMutex();
+    if (!mutex) {
+        return false;
+    }
+#endif
+    started = true;
+    return true;
+}
+
+uint8_t I2CBus::transfer(uint8_t address, const uint8_t *tx, size_t txLen, uint8_t *rx, size_t rxLen) {
+    if (!started) {
+        return ERR_NOT_STARTED;
+    }
+    acquire(address);
+    uint8_t result = OK;
+    if (txLen > 0) {
+        wire.beginTransmission(address);
+        wire.write(tx, txLen);
+        // Repeated start when a read follows
+        result = wire.endTransmission(rxLen == 0);
+    }
+    if (result == OK && rxLen > 0) {
+        size_t got = wire.requestFrom(address, (uint8_t)rxLen);
+        for (size_t i = 0; i < got && i < rxLen; i++) {
+            rx[i] = wire.read();
+        }
+        if (got < rxLen) {
+            result = ERR_SHORT_READ;
+        }
+    }
+
+    Device *dev = find(address);
+    if (dev) {
+        dev->transfers++;
+        if (result != OK) {
+            dev->errors++;
+        }
+    }
+    unlock();
+    return result;
+}
+
+void I2CBus::acquire(uint8_t address) {
+#if defined(ESP_PLATFORM)
+    if (mutex) {
+        xSemaphoreTakeRecursive((SemaphoreHandle_t)mutex, portMAX_DELAY);
+    }
+#endif
+    setClock(address);
+}
+
+void I2CBus::release(uint8_t address, bool ok) {
+    Device *dev = find(address);
+    if (dev) {
+        // Not a transfer, the driver may have made any number of them
+        dev->locks++;
+        if (!ok) {
+            dev->errors++;
+        }
+    }
+    // The driver may have changed the clock itself
+    clock = 0;
+    unlock();
+}
+
+bool I2CBus::probe(uint8_t address) {
+    if (!started) {
+        return false;
+    }
+    acquire(address);
+    wire.beginTransmission(address);
+    bool found = wire.endTransmission() == OK;
+    unlock();
+    return found;
+}
+
+const I2CBus::Device *I2CBus::device(uint8_t address) const {
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        if (devices[i].address == address) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+uint16_t I2CBus::errors() const {
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        sum += devices[i].errors;
+    }
+    return sum;
+}
+
+void I2CBus::printStats(Print &out) const {
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        const Device &dev = devices[i];
+        out.printf("I2C %s 0x%02X %lu kHz: %lu transfers, %lu locks, %u errors\n", dev.name, dev.address, (unsigned long)dev.clock / 1000,
+                   (unsigned long)dev.transfers, (unsigned long)dev.locks, dev.errors);
+    }
+}
+
+I2CBus::Device *I2CBus::find(uint8_t address) {
+    return const_cast<Device *>(device(address));
+}
+
+void I2CBus::setClock(uint8_t address) {
+    // Devices that weren't added get the speed every device supports
+    const Device *dev = find(address);
+    uint32_t wanted = dev ? dev->clock : STANDARD;
+    if (wanted != clock) {
+        wire.setClock(wanted);
+        clock = wanted;
+    }
+}
+
+void I2CBus::unlock() {
+#if defined(ESP_PLATFORM)
+    if (mutex) {
+        xSemaphoreGiveRecursive((SemaphoreHandle_t)mutex);
+    }
+#endif
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+// Owner of the I2C bus shared by the displays and sensors of the ESP32
+// projects. All devices are added with the fastest clock they support and
+// the bus is started once with begin(); after that every transaction runs
+// at the clock of the device it talks to.
+//
+// Transfers run in the calling task while it holds the bus mutex, the
+// Wire driver already blocks on its interrupt while the bytes move, so
+// the CPU can idle without a task in between. Drivers that talk to Wire
+// themselves (Adafruit_SSD1306, VL53L1X) hold a Lock, which takes the
+// same mutex and sets their clock.
+//
+// Errors, transfers and locks are counted per device. Without FreeRTOS
+// (host builds) there is no mutex.
+class I2CBus {
+   public:
+    // Bus speeds of the I2C spec
+    static const uint32_t STANDARD = 100000UL;
+    static const uint32_t FAST = 400000UL;
+    static const uint32_t FAST_PLUS = 1000000UL;
+    // Fastest clock the ESP32 I2C controllers run at, faster devices are
+    // clocked at this
+    static const uint32_t MAX_CLOCK = 800000UL;
+
+    static const uint8_t MAX_DEVICES = 6;
+
+    // Results, 0-5 are the same as Wire.endTransmission()
+    static const uint8_t OK = 0;
+    static const uint8_t ERR_SHORT_READ = 6;  // Device sent fewer bytes than asked for
+    static const uint8_t ERR_NOT_STARTED = 7;  // begin() wasn't called
+
+    struct Device {
+        uint8_t address;
+        uint32_t clock;
+        const char *name;
+        uint32_t transfers;
+        uint32_t locks;  // Held by a driver, which may have made any number of transfers
+        uint16_t errors;
+    };
+
+    // Holds the bus for a driver that uses Wire directly. Locks can be
+    // nested, and transfers can be made while holding one.
+    class Lock {
+       public:
+        Lock(I2CBus &bus, uint8_t address) : bus(bus), address(address), ok(true) { bus.acquire(address); }
+        ~Lock() { bus.release(address, ok); }
+        // Counts an error for the device when the lock is released
+        void fail() { ok = false; }
+
+       private:
+        I2CBus &bus;
+        uint8_t address;
+        bool ok;
+    };
+
+    explicit I2CBus(TwoWire &wire = Wire);
+
+    // Adds a device and the fastest clock it supports, capped at
+    // MAX_CLOCK. Devices have to be added before begin(), in the order
+    // they should be initialized.
+    bool add(uint8_t address, uint32_t clock, const char *name);
+    // Starts the bus. Only the first call does anything, so each project
+    // starts Wire in a single place.
+    bool begin(int sda = -1, int scl = -1);
+
+    // Writes `tx` (if any) and then reads `rxLen` bytes into `rx` (if
+    // any), with a repeated start in between. Returns ERR_NOT_STARTED
+    // before begin().
+    uint8_t transfer(uint8_t address, const uint8_t *tx, size_t txLen, uint8_t *rx = NULL, size_t rxLen = 0);
+    uint8_t write(uint8_t address, const uint8_t *tx, size_t txLen) { return transfer(address, tx, txLen); }
+    uint8_t read(uint8_t address, uint8_t *rx, size_t rxLen) { return transfer(address, NULL, 0, rx, rxLen); }
+
+    // True if a device answers at `address`. A device that doesn't isn't
+    // counted as an error, it may just not be fitted.
+    bool probe(uint8_t address);
+
+    // Used by Lock
+    void acquire(uint8_t address);
+    void release(uint8_t address, bool ok);
+
+    // NULL for addresses that weren't added
+    const Device *device(uint8_t address) const;
+    uint16_t errors() const;
+    // One line per device: address, clock, transfers, locks and errors
+    void printStats(Print &out) const;
+
+   private:
+    Device *find(uint8_t address);
+    void setClock(uint8_t address);
+    void unlock();
+
+    TwoWire &wire;
+    Device devices[MAX_DEVICES];
+    uint8_t deviceCount;
+    uint32_t clock;  // Current bus clock, 0 if unknown
+    bool started;
+    void *mutex;
+};
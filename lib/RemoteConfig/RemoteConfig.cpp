@@ -0,0 +1,140 @@
+#include "RemoteConfig.h"
+
+namespace {
+
+// Value size of `param`, 0 if it's unknown
+size_t valueSize(uint8_t param) {
+    switch (param) {
+        case RemoteConfig::MIN_INTERVAL:
+        case RemoteConfig::MAX_INTERVAL:
+            return 4;
+        case RemoteConfig::RANGE_DELTA:
+        case RemoteConfig::VOLTAGE_DELTA:
+        case RemoteConfig::BOOT_DELTA:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+uint32_t getUInt(const uint8_t *buf, size_t size) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+void putUInt(uint8_t *buf, uint32_t value, size_t size) {
+    for (size_t i = size; i > 0; i--) {
+        buf[i - 1] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+}  // namespace
+
+namespace RemoteConfig {
+
+Status apply(const uint8_t *buf, size_t len, Settings &settings, uint8_t lastSeq, uint8_t *seq) {
+    *seq = len > 0 ? buf[0] : 0;
+    if (len < 2) {
+        return BAD_LENGTH;
+    }
+    if (*seq != 0 && *seq == lastSeq) {
+        return DUPLICATE;
+    }
+    Settings updated = settings;
+    size_t pos = 1;
+    while (pos < len) {
+        uint8_t param = buf[pos++];
+        size_t size = valueSize(param);
+        if (size == 0) {
+            return UNKNOWN_PARAM;
+        }
+        if (pos + size > len) {
+            return BAD_LENGTH;
+        }
+        uint32_t value = getUInt(buf + pos, size);
+        pos += size;
+        switch (param) {
+            case MIN_INTERVAL:
+                updated.minInterval = value;
+                break;
+            case MAX_INTERVAL:
+                updated.maxInterval = value;
+                break;
+            case RANGE_DELTA:
+                updated.rangeDelta = value;
+                break;
+            case VOLTAGE_DELTA:
+                updated.voltageDelta = value;
+                break;
+            case BOOT_DELTA:
+                updated.bootDelta = value;
+                break;
+        }
+    }
+    if (!valid(updated)) {
+        return OUT_OF_RANGE;
+    }
+    settings = updated;
+    return OK;
+}
+
+bool valid(const Settings &settings) {
+    return settings.minInterval >= INTERVAL_MIN && settings.maxInterval <= INTERVAL_MAX &&
+           settings.minInterval <= settings.maxInterval &&
+           settings.rangeDelta > 0 && settings.rangeDelta <= RANGE_DELTA_MAX &&
+           settings.voltageDelta > 0 && settings.voltageDelta <= VOLTAGE_DELTA_MAX &&
+           settings.bootDelta > 0;
+}
+
+size_t encodeCommand(uint8_t seq, const Param *params, const uint32_t *values, uint8_t count, uint8_t *buf, size_t maxLen) {
+    if (count == 0 || maxLen < 1) {
+        return 0;
+    }
+    buf[0] = seq;
+    size_t len = 1;
+    for (uint8_t i = 0; i < count; i++) {
+        size_t size = valueSize(params[i]);
+        if (size == 0 || len + 1 + size > maxLen) {
+            return 0;
+        }
+        if (size < 4 && (values[i] >> (8 * size)) != 0) {
+            return 0;
+        }
+        buf[len++] = params[i];
+        putUInt(buf + len, values[i], size);
+        len += size;
+    }
+    return len;
+}
+
+size_t encodeAck(uint8_t seq, Status status, uint8_t *buf, size_t maxLen) {
+    if (maxLen < ACK_SIZE) {
+        return 0;
+    }
+    buf[0] = seq;
+    buf[1] = status;
+    return ACK_SIZE;
+}
+
+const char *describe(Status status) {
+    switch (status) {
+        case OK:
+            return "Command applied";
+        case UNKNOWN_PARAM:
+            return "Command has an unknown parameter";
+        case BAD_LENGTH:
+            return "Command has a bad length";
+        case OUT_OF_RANGE:
+            return "Command value out of range";
+        case DUPLICATE:
+            return "Command already applied";
+        default:
+            return "Unknown command status";
+    }
+}
+
+}  // namespace RemoteConfig
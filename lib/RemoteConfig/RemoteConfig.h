@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Downlink commands that change the sampling and reporting policy of the
+// depth sensor, and their acknowledgement. Shared by the firmware and the
+// host-side encoder, it only depends on the C standard library.
+
+namespace RemoteConfig {
+
+// FPort of the commands, and of the uplinks that acknowledge them
+const uint8_t PORT = 10;
+
+// What can be changed
+struct Settings {
+    uint32_t minInterval;   // Seconds between wakes while the level changes
+    uint32_t maxInterval;   // Seconds between wakes while the level is stable
+    uint16_t rangeDelta;    // Range change (mm) worth sending
+    uint16_t voltageDelta;  // Voltage change (mV) worth sending
+    uint16_t bootDelta;     // Number of wakes after which we send anyway
+};
+
+enum Param : uint8_t {
+    MIN_INTERVAL = 1,   // 4 bytes
+    MAX_INTERVAL = 2,   // 4 bytes
+    RANGE_DELTA = 3,    // 2 bytes
+    VOLTAGE_DELTA = 4,  // 2 bytes
+    BOOT_DELTA = 5,     // 2 bytes
+};
+
+enum Status : uint8_t {
+    OK = 0,
+    UNKNOWN_PARAM = 1,
+    BAD_LENGTH = 2,
+    OUT_OF_RANGE = 3,
+    DUPLICATE = 4,  // Same sequence number as the last applied command
+};
+
+// Limits of the values, outside of these a command is rejected
+const uint32_t INTERVAL_MIN = 60;
+const uint32_t INTERVAL_MAX = 30UL * 24 * 60 * 60;
+const uint16_t RANGE_DELTA_MAX = 4000;
+const uint16_t VOLTAGE_DELTA_MAX = 2000;
+
+// Command format (values big-endian):
+//   [0]  sequence number, echoed in the acknowledgement. A command with the
+//        same number as the last one applied is a repeat and is only
+//        acknowledged, 0 turns this check off.
+// followed by one or more parameters: the Param id and its value. The
+// command is applied as a whole or not at all.
+const size_t MAX_COMMAND_SIZE = 1 + 5 * 5;
+
+// Acknowledgement: the sequence number and the Status. It is sent in front
+// of the usual payload of the next uplink, on PORT instead of the usual
+// port.
+const size_t ACK_SIZE = 2;
+
+// Applies a command to `settings`, which is left alone unless the result
+// is OK. `lastSeq` is the sequence number of the last command applied.
+// Sets `seq` to the sequence number, or 0 if there is none.
+Status apply(const uint8_t *buf, size_t len, Settings &settings, uint8_t lastSeq, uint8_t *seq);
+
+// True if all values are within their limits and minInterval <= maxInterval
+bool valid(const Settings &settings);
+
+// Encodes a command setting `count` parameters. Returns the command length
+// or 0 if it doesn't fit, a parameter is unknown or a value doesn't fit
+// the size of its parameter.
+size_t encodeCommand(uint8_t seq, const Param *params, const uint32_t *values, uint8_t count, uint8_t *buf, size_t maxLen);
+
+size_t encodeAck(uint8_t seq, Status status, uint8_t *buf, size_t maxLen);
+
+// Short log message for `status`
+const char *describe(Status status);
+
+}  // namespace RemoteConfig